@@ -0,0 +1,163 @@
+// Measures how fast evpp::udp::Capture appends datagrams from one and from
+// four threads, then checks the ring: a small capture is wrapped around many
+// times with datagrams of varying sizes and read back with CaptureReader,
+// which must return exactly the newest datagrams, in order and intact.
+//
+// Usage: HelloEvppCaptureBenchmark [datagrams_per_thread=1000000] [size=64]
+
+#include <evpp/udp/udp_capture.h>
+#include <evpp/sockets.h>
+#include <evpp/timestamp.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+static const char* CapturePath = "capture_benchmark.cap";
+
+static void FillDatagram(uint64_t sequence, size_t size, std::vector<char>& datagram)
+{
+	datagram.resize(size);
+	memcpy(datagram.data(), &sequence, sizeof(sequence));
+	for (size_t i = sizeof(sequence); i < size; ++i)
+	{
+		datagram[i] = (char)(sequence + i);
+	}
+}
+
+static struct sockaddr_in SequenceAddress(uint64_t sequence)
+{
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)sequence);
+	addr.sin_addr.s_addr = htonl(0x7f000001);
+	return addr;
+}
+
+// Appends datagrams of 8 to 1407 bytes to a capture of the given capacity and
+// returns the number of problems found when reading it back
+static int CheckWraparound(uint64_t capacity, uint64_t datagrams)
+{
+	evpp::udp::Capture capture;
+	if (!capture.Open(CapturePath, capacity))
+	{
+		std::cout << "Error: Failed to open the capture file " << CapturePath << std::endl;
+		return 1;
+	}
+
+	std::vector<char> datagram;
+	for (uint64_t sequence = 0; sequence < datagrams; ++sequence)
+	{
+		FillDatagram(sequence, sizeof(sequence) + (sequence * 37) % 1400, datagram);
+		struct sockaddr_in addr = SequenceAddress(sequence);
+		capture.Append(evpp::sock::sockaddr_cast(&addr), datagram.data(), datagram.size());
+	}
+	const uint64_t kept = capture.record_count();
+	const uint64_t overwritten = capture.overwritten_count();
+	capture.Close();
+
+	int problems = 0;
+	if (kept + overwritten != datagrams)
+	{
+		std::cout << "  " << kept << " kept and " << overwritten << " overwritten, expected " << datagrams << " in total" << std::endl;
+		problems++;
+	}
+
+	evpp::udp::CaptureReader reader;
+	if (!reader.Open(CapturePath))
+	{
+		std::cout << "Error: Failed to read the capture file " << CapturePath << std::endl;
+		return problems + 1;
+	}
+
+	// The records left are the newest ones, from the first that was not overwritten to the last appended
+	evpp::udp::CaptureRecord record;
+	uint64_t expected = overwritten;
+	uint64_t read = 0;
+	while (reader.Next(record) && problems < 10)
+	{
+		uint64_t sequence = ~uint64_t(0);
+		if (record.data.size() >= sizeof(sequence))
+		{
+			memcpy(&sequence, record.data.data(), sizeof(sequence));
+		}
+
+		FillDatagram(expected, sizeof(expected) + (expected * 37) % 1400, datagram);
+		if (sequence != expected || record.data.size() != datagram.size()
+			|| memcmp(record.data.data(), datagram.data(), datagram.size()) != 0
+			|| record.remote_addr.sin_port != SequenceAddress(expected).sin_port)
+		{
+			std::cout << "  record " << read << " is not datagram " << expected << std::endl;
+			problems++;
+		}
+		expected++;
+		read++;
+	}
+
+	if (read != kept || expected != datagrams)
+	{
+		std::cout << "  read " << read << " of " << kept << " records, the last one is datagram " << expected - 1 << " of " << datagrams << std::endl;
+		problems++;
+	}
+	return problems;
+}
+
+int main(int argc, char** argv)
+{
+	const int perThread = argc > 1 ? std::atoi(argv[1]) : 1000000;
+	const size_t size = argc > 2 ? std::atoi(argv[2]) : 64;
+
+	std::cout << "append " << size << " byte datagrams   datagrams/s     MB/s   overwritten" << std::endl;
+	for (int threadCount : { 1, 4 })
+	{
+		evpp::udp::Capture capture;
+		if (!capture.Open(CapturePath, 64 * 1024 * 1024))
+		{
+			std::cout << "Error: Failed to open the capture file " << CapturePath << std::endl;
+			return 1;
+		}
+
+		const std::vector<char> datagram(size, 'x');
+		const struct sockaddr_in addr = SequenceAddress(1053);
+		std::vector<std::thread> threads;
+		evpp::Timestamp start = evpp::Timestamp::Now();
+		for (int t = 0; t < threadCount; ++t)
+		{
+			threads.emplace_back([&]()
+			{
+				for (int i = 0; i < perThread; ++i)
+				{
+					capture.Append(evpp::sock::sockaddr_cast(&addr), datagram.data(), datagram.size());
+				}
+			});
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		const double seconds = (evpp::Timestamp::Now() - start).Seconds();
+		const double total = (double)threadCount * perThread;
+
+		std::cout << threadCount << (threadCount == 1 ? " thread " : " threads") << "                  "
+			<< (uint64_t)(total / seconds) << "\t" << (uint64_t)(total * size / seconds / (1024 * 1024))
+			<< "\t" << capture.overwritten_count() << std::endl;
+	}
+
+	// Capacities that are not a multiple of the record sizes, so that the end of the
+	// data area is reached at every possible distance
+	int problems = 0;
+	for (uint64_t capacity : { 4096, 65536 + 8, 1000000 })
+	{
+		const uint64_t datagrams = capacity / 100 + 5000;
+		const int found = CheckWraparound(capacity, datagrams);
+		std::cout << "wraparound, capacity " << capacity << ", " << datagrams << " datagrams: " << (found ? "FAILED" : "ok") << std::endl;
+		problems += found;
+	}
+
+	std::remove(CapturePath);
+	return problems ? 1 : 0;
+}
@@ -0,0 +1,886 @@
+// Microbenchmarks and loopback throughput runs of the evpp building blocks the
+// game server relies on. The results can be written as JSON and compared with
+// the JSON of an earlier run, to catch performance regressions before a deploy.
+//
+// Usage: HelloEvppCoreBenchmark [--filter=tcp] [--seconds=1] [--repeat=3] [--port=1060]
+//                               [--json=results.json] [--baseline=baseline.json] [--tolerance=10]
+//
+//  filter     Only run the benchmark groups whose name contains this text: buffer,
+//             event_loop_queue_in_loop, invoke_timer, tcp, udp_echo and http.
+//             Every benchmark name starts with the name of its group.
+//  seconds    Length of every loopback run
+//  repeat     Runs of every benchmark, the best result is kept
+//  json       Write the results to this file, "-" writes them to stdout
+//  baseline   Compare with the JSON of an earlier run
+//  tolerance  Percentage by which a result may be worse than the baseline
+//
+// The progress, the errors and the comparison go to stderr. The exit code is 1
+// when a benchmark failed, or when a benchmark of the baseline regressed or is
+// missing from the groups that ran.
+//
+// A baseline only means something on the machine it was made on: make it there
+// with --json=baseline.json and pass --baseline=baseline.json to later runs.
+
+#include <evpp/buffer.h>
+#include <evpp/event_loop.h>
+#include <evpp/event_loop_thread.h>
+#include <evpp/invoke_timer.h>
+#include <evpp/libevent.h>
+#include <evpp/sockets.h>
+#include <evpp/tcp_client.h>
+#include <evpp/tcp_conn.h>
+#include <evpp/tcp_server.h>
+#include <evpp/timestamp.h>
+#include <evpp/udp/udp_server.h>
+#include <evpp/udp/udp_message.h>
+#include <evpp/http/http_server.h>
+#include <evpp/evpphttp/service.h>
+
+#include <rapidjson/document.h>
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Options
+{
+	std::string Filter;
+	double Seconds = 1.0;
+	int Repeat = 1;
+	int Port = 1060;
+	std::string JsonPath;
+	std::string BaselinePath;
+	double TolerancePercent = 10.0;
+};
+
+struct Result
+{
+	std::string Name;
+	double Value;
+	std::string Unit;
+	bool HigherIsBetter;
+};
+
+// One decimal, without leaving std::fixed set on the stream
+static std::string Fixed(double value)
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(1) << value;
+	return out.str();
+}
+
+class Results
+{
+public:
+	// Keeps the best value of the repeated runs
+	void Add(const std::string& name, double value, const std::string& unit, bool higherIsBetter)
+	{
+		for (Result& result : List)
+		{
+			if (result.Name == name)
+			{
+				result.Value = higherIsBetter ? std::max(result.Value, value) : std::min(result.Value, value);
+				return;
+			}
+		}
+
+		List.push_back({ name, value, unit, higherIsBetter });
+		std::cerr << std::left << std::setw(40) << name << std::right << std::setw(16) << Fixed(value) << " " << unit << std::endl;
+	}
+
+	// A benchmark which could not run or measured something wrong, the exit code becomes 1
+	void Fail(const std::string& message)
+	{
+		Failures++;
+		std::cerr << "Error: " << message << std::endl;
+	}
+
+	std::vector<Result> List;
+	int Failures = 0;
+};
+
+static double Since(evpp::Timestamp start)
+{
+	return (evpp::Timestamp::Now() - start).Seconds();
+}
+
+static bool WaitFor(const std::function<bool()>& done, double timeoutSeconds = 5.0)
+{
+	evpp::Timestamp start = evpp::Timestamp::Now();
+	while (!done())
+	{
+		if (Since(start) > timeoutSeconds)
+		{
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+static std::string LoopbackAddress(int port)
+{
+	return "127.0.0.1:" + std::to_string(port);
+}
+
+static double Percentile(std::vector<double>& values, double p)
+{
+	if (values.empty())
+	{
+		return 0.0;
+	}
+	std::sort(values.begin(), values.end());
+	return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+}
+
+// A connected pair of blocking TCP sockets over loopback
+static bool CreateTcpPair(int port, evpp_socket_t& client, evpp_socket_t& server)
+{
+	struct sockaddr_storage addr = evpp::sock::ParseFromIPPort(LoopbackAddress(port).c_str());
+	evpp_socket_t listener = ::socket(AF_INET, SOCK_STREAM, 0);
+	evpp::sock::SetReuseAddr(listener);
+	if (::bind(listener, evpp::sock::sockaddr_cast(&addr), sizeof(struct sockaddr_in)) != 0 || ::listen(listener, 1) != 0)
+	{
+		EVUTIL_CLOSESOCKET(listener);
+		return false;
+	}
+
+	client = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (::connect(client, evpp::sock::sockaddr_cast(&addr), sizeof(struct sockaddr_in)) != 0)
+	{
+		EVUTIL_CLOSESOCKET(client);
+		EVUTIL_CLOSESOCKET(listener);
+		return false;
+	}
+	server = ::accept(listener, nullptr, nullptr);
+	EVUTIL_CLOSESOCKET(listener);
+	return server != INVALID_SOCKET;
+}
+
+void BenchBuffer(const Options& options, Results& results)
+{
+	const char chunk[64] = {};
+
+	// A connection which keeps up with its input, the buffer never grows
+	{
+		const int count = 20 * 1000 * 1000;
+		evpp::Buffer buffer;
+		evpp::Timestamp start = evpp::Timestamp::Now();
+		for (int i = 0; i < count; ++i)
+		{
+			buffer.Append(chunk, sizeof(chunk));
+			buffer.Retrieve(sizeof(chunk));
+		}
+		results.Add("buffer_append_retrieve_64B", count / Since(start), "ops/s", true);
+	}
+
+	// Fresh buffers growing to 1MB
+	{
+		const int rounds = 256;
+		size_t bytes = 0;
+		evpp::Timestamp start = evpp::Timestamp::Now();
+		for (int r = 0; r < rounds; ++r)
+		{
+			evpp::Buffer buffer;
+			while (buffer.length() < 1024 * 1024)
+			{
+				buffer.Append(chunk, sizeof(chunk));
+			}
+			bytes += buffer.length();
+		}
+		results.Add("buffer_grow_1MB", bytes / Since(start) / (1024 * 1024), "MB/s", true);
+	}
+
+	// Integers in network order, as the length prefixed codecs use them
+	{
+		const int count = 20 * 1000 * 1000;
+		evpp::Buffer buffer;
+		int64_t sum = 0;
+		evpp::Timestamp start = evpp::Timestamp::Now();
+		for (int i = 0; i < count; ++i)
+		{
+			buffer.AppendInt32(i);
+			sum += buffer.ReadInt32();
+		}
+		results.Add("buffer_append_read_int32", count / Since(start), "ops/s", true);
+		if (sum != (int64_t)count * (count - 1) / 2)
+		{
+			results.Fail("buffer_append_read_int32 read wrong values");
+		}
+	}
+
+	// ReadFromFD from a loopback TCP socket a thread writes to as fast as it can
+	evpp_socket_t writer = INVALID_SOCKET;
+	evpp_socket_t reader = INVALID_SOCKET;
+	if (!CreateTcpPair(options.Port, writer, reader))
+	{
+		results.Fail("Failed to connect a loopback TCP pair on port " + std::to_string(options.Port));
+		return;
+	}
+
+	std::atomic<bool> stop(false);
+	std::thread writerThread([&]()
+	{
+		std::vector<char> data(64 * 1024, 'x');
+		while (!stop.load())
+		{
+			if (::send(writer, data.data(), (int)data.size(), 0) <= 0)
+			{
+				break;
+			}
+		}
+		EVUTIL_CLOSESOCKET(writer);
+	});
+
+	evpp::Buffer buffer;
+	uint64_t bytes = 0;
+	int savedErrno = 0;
+	evpp::Timestamp start = evpp::Timestamp::Now();
+	double elapsed = 0.0;
+	for (;;)
+	{
+		ssize_t n = buffer.ReadFromFD(reader, &savedErrno);
+		if (n <= 0)
+		{
+			break;
+		}
+		buffer.Retrieve(buffer.length());
+
+		// Read on until the writer closes the socket, so it is never left blocked
+		if (!stop.load())
+		{
+			bytes += n;
+			elapsed = Since(start);
+			stop.store(elapsed >= options.Seconds);
+		}
+	}
+	writerThread.join();
+	EVUTIL_CLOSESOCKET(reader);
+	results.Add("buffer_read_from_fd_tcp", bytes / elapsed / (1024 * 1024), "MB/s", true);
+}
+
+void BenchQueueInLoop(const Options&, Results& results)
+{
+	evpp::EventLoopThread loopThread;
+	loopThread.Start(true);
+	evpp::EventLoop* loop = loopThread.loop();
+
+	for (int producers : { 1, 4 })
+	{
+		const int perProducer = 500 * 1000;
+		std::atomic<int> executed(0);
+
+		evpp::Timestamp start = evpp::Timestamp::Now();
+		std::vector<std::thread> threads;
+		for (int p = 0; p < producers; ++p)
+		{
+			threads.emplace_back([&]()
+			{
+				for (int i = 0; i < perProducer; ++i)
+				{
+					loop->QueueInLoop([&executed]() { executed.fetch_add(1, std::memory_order_relaxed); });
+				}
+			});
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		const int total = producers * perProducer;
+		if (!WaitFor([&]() { return executed.load() == total; }, 30.0))
+		{
+			results.Fail("The loop did not run all the queued functors");
+			break;
+		}
+		results.Add("event_loop_queue_in_loop_" + std::to_string(producers) + "_threads", total / Since(start), "ops/s", true);
+	}
+
+	loopThread.Stop(true);
+}
+
+void BenchInvokeTimer(const Options&, Results& results)
+{
+	evpp::EventLoopThread loopThread;
+	loopThread.Start(true);
+	evpp::EventLoop* loop = loopThread.loop();
+
+	// In the loop thread, where Start and Cancel do not go through the queue
+	const int count = 200 * 1000;
+	std::atomic<bool> finished(false);
+	double elapsed = 0.0;
+	loop->RunInLoop([&]()
+	{
+		evpp::Timestamp start = evpp::Timestamp::Now();
+		for (int i = 0; i < count; ++i)
+		{
+			evpp::InvokeTimerPtr timer = evpp::InvokeTimer::Create(loop, evpp::Duration(60.0), []() {}, false);
+			timer->Start();
+			timer->Cancel();
+		}
+		elapsed = Since(start);
+		finished.store(true);
+	});
+
+	if (WaitFor([&]() { return finished.load(); }, 60.0))
+	{
+		results.Add("invoke_timer_create_cancel", count / elapsed, "ops/s", true);
+	}
+	else
+	{
+		results.Fail("invoke_timer_create_cancel did not finish within 60 s");
+	}
+
+	// Waits for the functor if it is still running
+	loopThread.Stop(true);
+}
+
+// Echoes everything it receives, on its own loop thread
+class TcpEchoServer
+{
+public:
+	explicit TcpEchoServer(int port)
+		: Server(nullptr)
+	{
+		LoopThread.Start(true);
+		Server.reset(new evpp::TCPServer(LoopThread.loop(), LoopbackAddress(port), "EchoServer", 0));
+		Server->SetMessageCallback([](const evpp::TCPConnPtr& conn, evpp::Buffer* buf) { conn->Send(buf); });
+		Server->SetConnectionCallback([](const evpp::TCPConnPtr& conn)
+		{
+			if (conn->IsConnected())
+			{
+				conn->SetTCPNoDelay(true);
+			}
+		});
+		Started = Server->Init() && Server->Start();
+	}
+
+	~TcpEchoServer()
+	{
+		if (Started)
+		{
+			Server->Stop();
+			WaitFor([&]() { return Server->IsStopped(); });
+		}
+		LoopThread.Stop(true);
+		Server.reset();
+	}
+
+	bool Started = false;
+
+private:
+	evpp::EventLoopThread LoopThread;
+	std::unique_ptr<evpp::TCPServer> Server;
+};
+
+// Keeps inFlight messages going back and forth over one connection
+void RunTcpPingPong(const Options& options, Results& results, const std::string& name, size_t messageSize, int inFlight)
+{
+	TcpEchoServer server(options.Port);
+	if (!server.Started)
+	{
+		results.Fail("Failed to start the echo server on port " + std::to_string(options.Port));
+		return;
+	}
+
+	evpp::EventLoopThread loopThread;
+	loopThread.Start(true);
+	evpp::TCPClient client(loopThread.loop(), LoopbackAddress(options.Port), "PingPongClient");
+
+	// Only touched in the client loop thread, the samples are taken from it there
+	const std::string message(messageSize, 'x');
+	std::vector<double> rttMicros;
+	evpp::Timestamp sentAt;
+	std::atomic<bool> running(true);
+	std::atomic<bool> measuring(false);
+	std::atomic<uint64_t> roundTrips(0);
+	std::atomic<int> connected(0);
+
+	client.SetConnectionCallback([&](const evpp::TCPConnPtr& conn)
+	{
+		if (conn->IsConnected())
+		{
+			conn->SetTCPNoDelay(true);
+			sentAt = evpp::Timestamp::Now();
+			for (int i = 0; i < inFlight; ++i)
+			{
+				conn->Send(message);
+			}
+		}
+		connected.store(conn->IsConnected() ? 1 : 0);
+	});
+	client.SetMessageCallback([&](const evpp::TCPConnPtr& conn, evpp::Buffer* buf)
+	{
+		while (buf->length() >= messageSize)
+		{
+			buf->Retrieve(messageSize);
+			if (measuring.load(std::memory_order_relaxed))
+			{
+				roundTrips.fetch_add(1, std::memory_order_relaxed);
+				if (inFlight == 1)
+				{
+					rttMicros.push_back((evpp::Timestamp::Now() - sentAt).Microseconds());
+				}
+			}
+			if (running.load(std::memory_order_relaxed))
+			{
+				sentAt = evpp::Timestamp::Now();
+				conn->Send(message);
+			}
+		}
+	});
+	client.Connect();
+
+	if (!WaitFor([&]() { return connected.load() == 1; }))
+	{
+		results.Fail("Failed to connect to the echo server");
+	}
+	else
+	{
+		// Warm up before measuring
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		measuring.store(true);
+		evpp::Timestamp start = evpp::Timestamp::Now();
+		std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(options.Seconds * 1000000)));
+		measuring.store(false);
+		const double elapsed = Since(start);
+		running.store(false);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+		// The samples are written by the client loop thread, so take them there
+		std::vector<double> samples;
+		std::atomic<bool> taken(false);
+		loopThread.loop()->RunInLoop([&]()
+		{
+			samples.swap(rttMicros);
+			taken.store(true);
+		});
+		WaitFor([&]() { return taken.load(); });
+
+		const double rate = roundTrips.load() / elapsed;
+		if (inFlight == 1)
+		{
+			results.Add(name, rate, "round_trips/s", true);
+			results.Add(name + "_rtt_p50", Percentile(samples, 0.50), "us", false);
+			results.Add(name + "_rtt_p99", Percentile(samples, 0.99), "us", false);
+		}
+		else
+		{
+			results.Add(name, rate * messageSize / (1024 * 1024), "MB/s", true);
+		}
+	}
+
+	client.Disconnect();
+	WaitFor([&]() { return connected.load() == 0; });
+	loopThread.Stop(true);
+}
+
+void BenchTcp(const Options& options, Results& results)
+{
+	RunTcpPingPong(options, results, "tcp_pingpong_64B", 64, 1);
+	RunTcpPingPong(options, results, "tcp_stream_16KB", 16 * 1024, 8);
+}
+
+void BenchUdpEcho(const Options& options, Results& results)
+{
+	evpp::udp::Server server;
+	server.SetMessageHandler([](evpp::EventLoop*, evpp::udp::MessagePtr& msg) { evpp::udp::SendMessage(msg); });
+	if (!server.Init(options.Port) || !server.Start())
+	{
+		results.Fail("Failed to start the echo server on port " + std::to_string(options.Port));
+		return;
+	}
+
+	struct sockaddr_storage to = evpp::sock::ParseFromIPPort(LoopbackAddress(options.Port).c_str());
+	evpp_socket_t fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+	evpp::sock::SetTimeout(fd, 100);
+
+	const std::string message(64, 'x');
+	char reply[1500];
+	std::vector<double> rttMicros;
+	uint64_t timeouts = 0;
+	evpp::Timestamp start = evpp::Timestamp::Now();
+	while (Since(start) < options.Seconds)
+	{
+		evpp::Timestamp sentAt = evpp::Timestamp::Now();
+		::sendto(fd, message.data(), (int)message.size(), 0, evpp::sock::sockaddr_cast(&to), sizeof(struct sockaddr_in));
+		if (::recv(fd, reply, sizeof(reply), 0) > 0)
+		{
+			rttMicros.push_back((evpp::Timestamp::Now() - sentAt).Microseconds());
+		}
+		else
+		{
+			timeouts++;
+		}
+	}
+	const double elapsed = Since(start);
+
+	EVUTIL_CLOSESOCKET(fd);
+	server.Stop(true);
+
+	results.Add("udp_echo_64B", rttMicros.size() / elapsed, "round_trips/s", true);
+	results.Add("udp_echo_64B_rtt_p99", Percentile(rttMicros, 0.99), "us", false);
+	if (timeouts > 0)
+	{
+		std::cerr << "  " << timeouts << " udp echo requests timed out" << std::endl;
+	}
+}
+
+// Keeps one GET in flight on every connection and adds the responses per second
+void RunHttpClients(const Options& options, Results& results, const std::string& name, int connections)
+{
+	static const char Request[] = "GET /bench HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n";
+	static const char ContentLength[] = "Content-Length:";
+
+	evpp::EventLoopThread loopThread;
+	loopThread.Start(true);
+
+	std::atomic<bool> running(true);
+	std::atomic<int> connected(0);
+	std::atomic<uint64_t> responses(0);
+	std::atomic<uint64_t> failures(0);
+
+	auto onMessage = [&](const evpp::TCPConnPtr& conn, evpp::Buffer* buf)
+	{
+		for (;;)
+		{
+			const char* begin = buf->data();
+			const char* end = begin + buf->length();
+			const char* terminator = "\r\n\r\n";
+			const char* headersEnd = std::search(begin, end, terminator, terminator + 4);
+			if (headersEnd == end)
+			{
+				return;
+			}
+
+			size_t bodyLength = 0;
+			for (const char* line = begin; line < headersEnd; line = std::find(line, headersEnd, '\n') + 1)
+			{
+				if (evutil_ascii_strncasecmp(line, ContentLength, sizeof(ContentLength) - 1) == 0)
+				{
+					bodyLength = (size_t)std::strtoul(line + sizeof(ContentLength) - 1, nullptr, 10);
+				}
+			}
+
+			const size_t total = (headersEnd + 4 - begin) + bodyLength;
+			if (buf->length() < total)
+			{
+				return;
+			}
+
+			if (strncmp(begin + 8, " 200", 4) != 0)
+			{
+				failures++;
+			}
+			buf->Retrieve(total);
+			responses.fetch_add(1, std::memory_order_relaxed);
+			if (running.load(std::memory_order_relaxed))
+			{
+				conn->Send(Request, sizeof(Request) - 1);
+			}
+		}
+	};
+
+	std::vector<std::unique_ptr<evpp::TCPClient>> clients;
+	for (int c = 0; c < connections; ++c)
+	{
+		clients.emplace_back(new evpp::TCPClient(loopThread.loop(), LoopbackAddress(options.Port), "HttpClient"));
+		clients.back()->SetConnectionCallback([&](const evpp::TCPConnPtr& conn)
+		{
+			if (conn->IsConnected())
+			{
+				connected++;
+				conn->SetTCPNoDelay(true);
+				conn->Send(Request, sizeof(Request) - 1);
+			}
+			else
+			{
+				connected--;
+			}
+		});
+		clients.back()->SetMessageCallback(onMessage);
+		clients.back()->Connect();
+	}
+
+	if (!WaitFor([&]() { return connected.load() == connections; }))
+	{
+		results.Fail("Failed to connect to the http server");
+	}
+	else
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		const uint64_t before = responses.load();
+		evpp::Timestamp start = evpp::Timestamp::Now();
+		std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(options.Seconds * 1000000)));
+		results.Add(name, (responses.load() - before) / Since(start), "requests/s", true);
+		running.store(false);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	if (failures.load() > 0)
+	{
+		results.Fail(name + ": " + std::to_string(failures.load()) + " http responses were not 200 OK");
+	}
+
+	for (auto& client : clients)
+	{
+		client->Disconnect();
+	}
+	WaitFor([&]() { return connected.load() == 0; });
+	loopThread.Stop(true);
+}
+
+void BenchHttp(const Options& options, Results& results)
+{
+	const int connections = 8;
+	const int threads = 2;
+
+	{
+		evpp::http::Server server(threads);
+		server.RegisterHandler("/bench", [](evpp::EventLoop*, const evpp::http::ContextPtr&, const evpp::http::HTTPSendResponseCallback& respcb)
+		{
+			respcb("hello");
+		});
+		if (!server.Init(options.Port) || !server.Start())
+		{
+			results.Fail("Failed to start the http server on port " + std::to_string(options.Port));
+			return;
+		}
+		RunHttpClients(options, results, "http_server_keep_alive", connections);
+		server.Stop();
+		WaitFor([&]() { return server.IsStopped(); });
+	}
+
+	{
+		evpp::evpphttp::Service service(LoopbackAddress(options.Port), "BenchService", threads);
+		service.RegisterHandler("/bench", [](evpp::EventLoop*, evpp::evpphttp::HttpRequest&, const evpp::evpphttp::HTTPSendResponseCallback& respcb)
+		{
+			respcb(200, std::map<std::string, std::string>(), "hello");
+		});
+		if (!service.Init() || !service.Start())
+		{
+			results.Fail("Failed to start the evpphttp service on port " + std::to_string(options.Port));
+			return;
+		}
+		RunHttpClients(options, results, "http_evpphttp_service_keep_alive", connections);
+		service.Stop();
+	}
+}
+
+bool WriteJson(std::ostream& out, const Options& options, const Results& results)
+{
+	rapidjson::StringBuffer buffer;
+	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+	writer.StartObject();
+	writer.Key("seconds");
+	writer.Double(options.Seconds);
+	writer.Key("repeat");
+	writer.Int(options.Repeat);
+	writer.Key("benchmarks");
+	writer.StartArray();
+	for (const Result& result : results.List)
+	{
+		writer.StartObject();
+		writer.Key("name");
+		writer.String(result.Name.c_str(), (rapidjson::SizeType)result.Name.size());
+		writer.Key("value");
+		writer.Double(result.Value);
+		writer.Key("unit");
+		writer.String(result.Unit.c_str(), (rapidjson::SizeType)result.Unit.size());
+		writer.Key("higher_is_better");
+		writer.Bool(result.HigherIsBetter);
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	out << buffer.GetString() << std::endl;
+	return (bool)out;
+}
+
+// Reads the name and value pairs of a file written by WriteJson
+bool ReadBaseline(const std::string& path, std::map<std::string, double>& baseline)
+{
+	std::ifstream in(path);
+	if (!in)
+	{
+		return false;
+	}
+
+	const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	rapidjson::Document document;
+	document.Parse(text.c_str(), text.size());
+	if (document.HasParseError() || !document.IsObject() || !document.HasMember("benchmarks") || !document["benchmarks"].IsArray())
+	{
+		return false;
+	}
+
+	for (const rapidjson::Value& benchmark : document["benchmarks"].GetArray())
+	{
+		if (!benchmark.IsObject() || !benchmark.HasMember("name") || !benchmark["name"].IsString()
+			|| !benchmark.HasMember("value") || !benchmark["value"].IsNumber())
+		{
+			return false;
+		}
+		baseline[benchmark["name"].GetString()] = benchmark["value"].GetDouble();
+	}
+	return true;
+}
+
+// @param[in] groups - The benchmark groups which ran, the baseline results of the others are not expected
+// @return The count of results worse than the baseline by more than the tolerance or missing
+int CompareWithBaseline(const Options& options, const Results& results, const std::map<std::string, double>& baseline, const std::vector<std::string>& groups)
+{
+	int regressions = 0;
+	std::cerr << std::endl << std::left << std::setw(40) << "benchmark" << std::right << std::setw(16) << "baseline" << std::setw(16) << "current" << std::setw(10) << "change" << std::endl;
+	for (const Result& result : results.List)
+	{
+		auto it = baseline.find(result.Name);
+		std::cerr << std::left << std::setw(40) << result.Name << std::right;
+		if (it == baseline.end() || it->second == 0.0)
+		{
+			std::cerr << std::setw(16) << "-" << std::setw(16) << Fixed(result.Value) << std::setw(10) << "new" << std::endl;
+			continue;
+		}
+
+		// Positive is better, whichever direction the unit goes
+		const double change = (result.Value - it->second) / it->second * 100.0 * (result.HigherIsBetter ? 1.0 : -1.0);
+		const bool regressed = change < -options.TolerancePercent;
+		regressions += regressed ? 1 : 0;
+		// Rounded as printed, and + 0.0 turns -0.0 into 0.0, so that no change reads "+0.0" and not "+-0.0"
+		const double shown = std::round(change * 10.0) / 10.0 + 0.0;
+		std::cerr << std::setw(16) << Fixed(it->second) << std::setw(16) << Fixed(result.Value) << std::setw(9) << ((shown >= 0.0 ? "+" : "") + Fixed(shown)) << "%"
+			<< (regressed ? "  REGRESSION" : "") << std::endl;
+	}
+
+	// A benchmark of a group which ran but produced no result, or of a group which no longer exists
+	for (const auto& entry : baseline)
+	{
+		const bool measured = std::any_of(results.List.begin(), results.List.end(), [&](const Result& result) { return result.Name == entry.first; });
+		const bool expected = options.Filter.empty() || std::any_of(groups.begin(), groups.end(), [&](const std::string& group) { return entry.first.compare(0, group.size(), group) == 0; });
+		if (!measured && expected)
+		{
+			regressions++;
+			std::cerr << std::left << std::setw(40) << entry.first << std::right << std::setw(16) << Fixed(entry.second) << std::setw(16) << "-" << std::setw(10) << "missing" << "  REGRESSION" << std::endl;
+		}
+	}
+	return regressions;
+}
+
+bool ParseOption(const char* arg, const char* name, std::string& value)
+{
+	const size_t length = strlen(name);
+	if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, length) != 0 || arg[2 + length] != '=')
+	{
+		return false;
+	}
+	value = arg + 3 + length;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+#ifdef _WIN32
+	WSADATA wsadata;
+	if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
+	{
+		std::cerr << "Error: Failed to initialize winsock API." << std::endl;
+		return 1;
+	}
+#endif
+
+	Options options;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string value;
+		if (ParseOption(argv[i], "filter", value)) { options.Filter = value; }
+		else if (ParseOption(argv[i], "seconds", value)) { options.Seconds = std::max(0.1, std::atof(value.c_str())); }
+		else if (ParseOption(argv[i], "repeat", value)) { options.Repeat = std::max(1, std::atoi(value.c_str())); }
+		else if (ParseOption(argv[i], "port", value)) { options.Port = std::atoi(value.c_str()); }
+		else if (ParseOption(argv[i], "json", value)) { options.JsonPath = value; }
+		else if (ParseOption(argv[i], "baseline", value)) { options.BaselinePath = value; }
+		else if (ParseOption(argv[i], "tolerance", value)) { options.TolerancePercent = std::atof(value.c_str()); }
+		else
+		{
+			std::cerr << "Error: Unknown option " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+
+	std::map<std::string, double> baseline;
+	if (!options.BaselinePath.empty() && !ReadBaseline(options.BaselinePath, baseline))
+	{
+		std::cerr << "Error: Failed to read the baseline " << options.BaselinePath << std::endl;
+		return 1;
+	}
+
+	const std::vector<std::pair<std::string, std::function<void(const Options&, Results&)>>> benchmarks = {
+		{ "buffer", BenchBuffer },
+		{ "event_loop_queue_in_loop", BenchQueueInLoop },
+		{ "invoke_timer", BenchInvokeTimer },
+		{ "tcp", BenchTcp },
+		{ "udp_echo", BenchUdpEcho },
+		{ "http", BenchHttp },
+	};
+
+	std::vector<std::string> groups;
+	for (auto& benchmark : benchmarks)
+	{
+		if (benchmark.first.find(options.Filter) != std::string::npos)
+		{
+			groups.push_back(benchmark.first);
+		}
+	}
+	if (groups.empty())
+	{
+		std::cerr << "Error: No benchmark group matches the filter " << options.Filter << std::endl;
+		return 1;
+	}
+
+	Results results;
+	for (int run = 0; run < options.Repeat; ++run)
+	{
+		for (auto& benchmark : benchmarks)
+		{
+			if (std::find(groups.begin(), groups.end(), benchmark.first) != groups.end())
+			{
+				benchmark.second(options, results);
+			}
+		}
+	}
+
+	int failures = results.Failures;
+	if (options.JsonPath == "-")
+	{
+		WriteJson(std::cout, options, results);
+	}
+	else if (!options.JsonPath.empty())
+	{
+		std::ofstream out(options.JsonPath);
+		if (!WriteJson(out, options, results))
+		{
+			std::cerr << "Error: Failed to write " << options.JsonPath << std::endl;
+			failures++;
+		}
+	}
+
+	if (!options.BaselinePath.empty())
+	{
+		failures += CompareWithBaseline(options, results, baseline, groups);
+	}
+	return failures > 0 ? 1 : 0;
+}
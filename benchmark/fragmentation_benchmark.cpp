@@ -0,0 +1,121 @@
+// Sends large messages as fragments over loopback while dropping a share of
+// the fragments before they reach the socket, and reports how many messages
+// and bytes get through for each loss rate.
+//
+// Usage: HelloEvppFragmentationBenchmark [message_size=16384] [messages=20000] [port=1055]
+
+#include "fragmentation.h"
+#include "packets.h"
+
+#include <evpp/libevent.h>
+#include <evpp/sockets.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+#ifdef _WIN32
+	WSADATA wsadata;
+	if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
+	{
+		std::cout << "Error: Failed to initialize winsock API." << std::endl;
+		return 1;
+	}
+#endif
+
+	const size_t messageSize = argc > 1 ? std::atoi(argv[1]) : 16384;
+	const int messageCount = argc > 2 ? std::atoi(argv[2]) : 20000;
+	const int port = argc > 3 ? std::atoi(argv[3]) : 1055;
+
+	evpp_socket_t receiver = evpp::sock::CreateUDPServer(port);
+	evpp_socket_t sender = ::socket(AF_INET, SOCK_DGRAM, 0);
+	if (receiver == INVALID_SOCKET || sender == INVALID_SOCKET)
+	{
+		std::cout << "Error: Failed to create the sockets on port " << port << std::endl;
+		return 1;
+	}
+	evutil_make_socket_nonblocking(receiver);
+
+	struct sockaddr_storage to = evpp::sock::ParseFromIPPort(("127.0.0.1:" + std::to_string(port)).c_str());
+
+	std::vector<uint8_t> message(messageSize);
+	for (size_t i = 0; i < messageSize; ++i)
+	{
+		message[i] = (uint8_t)i;
+	}
+
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<double> chance(0.0, 1.0);
+	std::vector<uint8_t> buffer(MAX_PACKET_SIZE);
+
+	std::cout << "message size: " << messageSize << " bytes, " << Fragmenter(MAX_PACKET_SIZE).GetFragmentCount(messageSize) << " fragments" << std::endl;
+	std::cout << "loss    delivered   messages/s   MB/s    expired  evicted  rejected  memory" << std::endl;
+
+	for (double loss : { 0.0, 0.001, 0.01, 0.05, 0.10 })
+	{
+		Fragmenter fragmenter(MAX_PACKET_SIZE);
+		Reassembler reassembler(1, 16, MAX_MESSAGE_SIZE, MAX_PACKET_SIZE, 100);
+		uint64_t delivered = 0;
+		bool corrupted = false;
+
+		auto start = std::chrono::steady_clock::now();
+		auto nowMs = [&]() { return (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(); };
+
+		auto drain = [&]()
+		{
+			for (;;)
+			{
+				int n = ::recv(receiver, (char*)buffer.data(), (int)buffer.size(), 0);
+				if (n <= 0)
+				{
+					return;
+				}
+
+				const uint8_t* data = nullptr;
+				size_t size = 0;
+				if (reassembler.Add(0, buffer.data(), n, nowMs(), data, size))
+				{
+					delivered++;
+					corrupted = corrupted || size != messageSize || memcmp(data, message.data(), size) != 0;
+				}
+			}
+		};
+
+		for (int i = 0; i < messageCount; ++i)
+		{
+			fragmenter.Split(message.data(), message.size(), [&](const uint8_t* fragment, size_t size)
+			{
+				if (chance(rng) >= loss)
+				{
+					::sendto(sender, (const char*)fragment, (int)size, 0, evpp::sock::sockaddr_cast(&to), sizeof(struct sockaddr_in));
+				}
+			});
+
+			// Keep the loopback receive buffer from overflowing, which would add to the loss
+			drain();
+		}
+		drain();
+
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const ReassemblyStats& stats = reassembler.GetStats();
+		std::cout << loss * 100 << "%\t" << delivered << "/" << messageCount
+			<< "\t" << (int)(delivered / elapsed)
+			<< "\t" << delivered * messageSize / elapsed / (1024 * 1024)
+			<< "\t" << stats.Expired << "\t" << stats.Evicted << "\t" << stats.Rejected
+			<< "\t" << reassembler.GetMemoryUsage() / 1024 << " KB" << std::endl;
+
+		if (corrupted)
+		{
+			std::cout << "Error: a reassembled message differs from the original" << std::endl;
+			return 1;
+		}
+	}
+
+	EVUTIL_CLOSESOCKET(sender);
+	EVUTIL_CLOSESOCKET(receiver);
+	return 0;
+}
@@ -0,0 +1,104 @@
+// Measures the per tick cost of InterestManager with moving entities and clients:
+// visibility update (enter/leave deltas) and priority selection of the updates to send.
+//
+// Usage: HelloEvppInterestBenchmark [entities=10000] [clients=2000] [ticks=200] [world_size=4096]
+
+#include "interest.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+	const uint32_t entityCount = argc > 1 ? std::atoi(argv[1]) : 10000;
+	const uint16_t clientCount = argc > 2 ? (uint16_t)std::atoi(argv[2]) : 2000;
+	const int tickCount = argc > 3 ? std::atoi(argv[3]) : 200;
+	const float worldSize = argc > 4 ? (float)std::atof(argv[4]) : 4096.0f;
+
+	const float viewRadius = 256.0f;
+	const uint32_t budgetBytes = 1200;
+	const uint32_t bytesPerEntity = 12;
+
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> position(0.0f, worldSize);
+	std::uniform_real_distribution<float> step(-4.0f, 4.0f);
+	std::uniform_real_distribution<float> importance(0.5f, 2.0f);
+
+	InterestManager interest(viewRadius * 0.5f, viewRadius, entityCount, clientCount);
+
+	std::vector<float> x(entityCount), y(entityCount);
+	for (uint32_t e = 0; e < entityCount; ++e)
+	{
+		x[e] = position(rng);
+		y[e] = position(rng);
+		interest.SetEntity(e, x[e], y[e], importance(rng));
+	}
+
+	// Clients follow the first entities, like players following their avatar
+	for (uint16_t c = 0; c < clientCount; ++c)
+	{
+		interest.SetClient(c, x[c % entityCount], y[c % entityCount]);
+	}
+
+	uint64_t enters = 0, leaves = 0, updates = 0;
+	std::vector<uint32_t> entered, left, selected;
+
+	double moveSeconds = 0.0, updateSeconds = 0.0, selectSeconds = 0.0;
+	for (int tick = 0; tick < tickCount; ++tick)
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		for (uint32_t e = 0; e < entityCount; ++e)
+		{
+			x[e] = std::min(std::max(x[e] + step(rng), 0.0f), worldSize);
+			y[e] = std::min(std::max(y[e] + step(rng), 0.0f), worldSize);
+			interest.SetEntity(e, x[e], y[e]);
+		}
+		for (uint16_t c = 0; c < clientCount; ++c)
+		{
+			interest.SetClient(c, x[c % entityCount], y[c % entityCount]);
+		}
+
+		auto t1 = std::chrono::steady_clock::now();
+		interest.Update();
+
+		auto t2 = std::chrono::steady_clock::now();
+		for (uint16_t c = 0; c < clientCount; ++c)
+		{
+			// Like one full replication packet per client and tick
+			entered.clear();
+			left.clear();
+			interest.TakeVisibilityChanges(c, 64, 64, entered, left);
+			enters += entered.size();
+			leaves += left.size();
+
+			selected.clear();
+			interest.SelectUpdates(c, budgetBytes, bytesPerEntity, selected);
+			updates += selected.size();
+		}
+		auto t3 = std::chrono::steady_clock::now();
+
+		moveSeconds += std::chrono::duration<double>(t1 - t0).count();
+		updateSeconds += std::chrono::duration<double>(t2 - t1).count();
+		selectSeconds += std::chrono::duration<double>(t3 - t2).count();
+	}
+
+	uint64_t visible = 0;
+	for (uint16_t c = 0; c < clientCount; ++c)
+	{
+		visible += interest.GetVisible(c).size();
+	}
+
+	std::cout << "entities / clients:      " << entityCount << " / " << clientCount << std::endl;
+	std::cout << "avg visible per client:  " << (double)visible / clientCount << std::endl;
+	std::cout << "enter / leave per tick:  " << (double)enters / tickCount << " / " << (double)leaves / tickCount << std::endl;
+	std::cout << "updates sent per tick:   " << (double)updates / tickCount << std::endl;
+	std::cout << "move cost per tick:      " << moveSeconds * 1e3 / tickCount << " ms" << std::endl;
+	std::cout << "update cost per tick:    " << updateSeconds * 1e3 / tickCount << " ms" << std::endl;
+	std::cout << "select cost per tick:    " << selectSeconds * 1e3 / tickCount << " ms" << std::endl;
+	std::cout << "total cost per tick:     " << (moveSeconds + updateSeconds + selectSeconds) * 1e3 / tickCount << " ms" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,164 @@
+// Compares the asynchronous logging backend with synchronous logging to a
+// file (std::ofstream and std::endl under a mutex, as with std::cout) in two
+// ways: log calls per second from several threads, and the datagrams per
+// second a loopback evpp::udp::Server handles when it logs every datagram.
+//
+// The rings are sized so that the log call rows drop nothing, and a row only
+// ends once the background thread has written everything: the rates are the
+// messages actually written per second, not the calls the rings absorbed.
+//
+// Usage: HelloEvppLoggingBenchmark [calls_per_thread=200000] [udp_seconds=2] [port=1056]
+
+#include <evpp/async_logging.h>
+#include <evpp/udp/udp_server.h>
+#include <evpp/udp/udp_message.h>
+#include <evpp/libevent.h>
+#include <evpp/sockets.h>
+#include <evpp/timestamp.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const char* SyncLogPath = "logging_benchmark_sync.log";
+static const char* AsyncLogPath = "logging_benchmark_async.log";
+
+static std::ofstream SyncLog;
+static std::mutex SyncLogMutex;
+
+static void SyncLogLine(int i, const char* what)
+{
+	std::lock_guard<std::mutex> guard(SyncLogMutex);
+	SyncLog << __FILE__ << ":" << __LINE__ << " " << what << " " << i << " of the benchmark" << std::endl;
+}
+
+// Runs the function from each thread and returns the total calls per second,
+// including the time the asynchronous logger needs to write them
+static double MeasureCalls(int threadCount, int callsPerThread, const std::function<void(int)>& call)
+{
+	std::vector<std::thread> threads;
+	evpp::Timestamp start = evpp::Timestamp::Now();
+	for (int t = 0; t < threadCount; ++t)
+	{
+		threads.emplace_back([&]()
+		{
+			for (int i = 0; i < callsPerThread; ++i)
+			{
+				call(i);
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	evpp::AsyncLogger::Instance().Flush();
+	return (double)threadCount * callsPerThread / (evpp::Timestamp::Now() - start).Seconds();
+}
+
+int main(int argc, char** argv)
+{
+#ifdef _WIN32
+	WSADATA wsadata;
+	if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
+	{
+		std::cout << "Error: Failed to initialize winsock API." << std::endl;
+		return 1;
+	}
+#endif
+
+	const int callsPerThread = argc > 1 ? std::atoi(argv[1]) : 200000;
+	const double udpSeconds = argc > 2 ? std::atof(argv[2]) : 2.0;
+	const int port = argc > 3 ? std::atoi(argv[3]) : 1056;
+
+	SyncLog.open(SyncLogPath, std::ios::out | std::ios::trunc);
+	std::remove(AsyncLogPath);
+	evpp::AsyncLogger& logger = evpp::AsyncLogger::Instance();
+
+	// Room for every call of a thread, a record takes 64 bytes with its header
+	logger.set_ring_size((size_t)callsPerThread * 64);
+	if (!SyncLog || !logger.SetOutput(AsyncLogPath))
+	{
+		std::cout << "Error: Failed to open the log files" << std::endl;
+		return 1;
+	}
+
+	std::cout << "log calls/s           1 thread      4 threads     dropped" << std::endl;
+	auto row = [&](const char* name, const std::function<void(int)>& call)
+	{
+		uint64_t droppedBefore = logger.dropped_count();
+		double one = MeasureCalls(1, callsPerThread, call);
+		double four = MeasureCalls(4, callsPerThread, call);
+		std::cout << name << "\t" << (uint64_t)one << "\t" << (uint64_t)four << "\t" << logger.dropped_count() - droppedBefore << std::endl;
+	};
+
+	row("sync ofstream+endl", [](int i) { SyncLogLine(i, "message"); });
+	row("async ALOG_INFO   ", [](int i) { ALOG_INFO << "message " << i << " of the benchmark"; });
+	row("async ALOG_EVERY_MS", [](int i) { ALOG_EVERY_MS(evpp::kLogInfo, 100) << "message " << i << " of the benchmark"; });
+	row("compiled out TRACE", [](int i) { ALOG_TRACE << "message " << i << " of the benchmark"; });
+
+	// Datagrams handled per second, the handler logs every datagram
+	std::cout << std::endl << "udp handler           datagrams/s" << std::endl;
+
+	struct sockaddr_storage to = evpp::sock::ParseFromIPPort(("127.0.0.1:" + std::to_string(port)).c_str());
+	evpp_socket_t sender = ::socket(AF_INET, SOCK_DGRAM, 0);
+	const std::string payload(64, 'x');
+
+	std::function<void(int)> handlers[] = {
+		[](int) {},
+		[](int i) { SyncLogLine(i, "recv"); },
+		[](int i) { ALOG_INFO << "recv " << i << " of the benchmark"; },
+	};
+	const char* names[] = { "no logging         ", "sync ofstream+endl ", "async ALOG_INFO    " };
+
+	for (int mode = 0; mode < 3; ++mode)
+	{
+		std::atomic<int> handled(0);
+		const std::function<void(int)>& log = handlers[mode];
+
+		evpp::udp::Server server;
+		server.SetMessageHandler([&](evpp::EventLoop*, evpp::udp::MessagePtr&) { log(handled++); });
+		if (!server.Init(port) || !server.Start())
+		{
+			std::cout << "Error: Failed to start the server on port " << port << std::endl;
+			return 1;
+		}
+
+		// Send as fast as the socket allows, what the server does not keep up with is lost
+		uint64_t droppedBefore = logger.dropped_count();
+		evpp::Timestamp start = evpp::Timestamp::Now();
+		while ((evpp::Timestamp::Now() - start).Seconds() < udpSeconds)
+		{
+			for (int i = 0; i < 64; ++i)
+			{
+				::sendto(sender, payload.data(), (int)payload.size(), 0, evpp::sock::sockaddr_cast(&to), sizeof(struct sockaddr_in));
+			}
+		}
+		double elapsed = (evpp::Timestamp::Now() - start).Seconds();
+		int count = handled.load();
+		server.Stop(true);
+		logger.Flush();
+
+		std::cout << names[mode] << "\t" << (uint64_t)(count / elapsed);
+		if (logger.dropped_count() != droppedBefore)
+		{
+			std::cout << "\t(" << logger.dropped_count() - droppedBefore << " log messages dropped)";
+		}
+		std::cout << std::endl;
+	}
+
+	EVUTIL_CLOSESOCKET(sender);
+	logger.Stop();
+	std::cout << std::endl << "async messages written: " << logger.written_count() << ", dropped: " << logger.dropped_count() << std::endl;
+
+	SyncLog.close();
+	std::remove(SyncLogPath);
+	std::remove(AsyncLogPath);
+	return 0;
+}
@@ -0,0 +1,148 @@
+// Measures GamePacketRegistry: encoding, and decoding plus dispatching a mixed
+// stream of datagrams. The same stream is also dispatched by a hand written
+// switch on the id byte, which is the cost the jump table has to match.
+//
+// Usage: HelloEvppPacketDispatchBenchmark [packets=1000000] [rounds=10]
+
+#include "packets.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+struct CountingHandler
+{
+	uint64_t Sink = 0;
+
+	void OnPacket(const EntityReplicationPacket& packet) { Sink += packet.Entered.Size() + packet.Left.Size() + packet.Updates.Size(); }
+	void OnPacket(const ConnectionRequestPacket&) { Sink += 1; }
+	void OnPacket(const ConnectionResponsePacket& packet) { Sink += packet.ClientIdentifier; }
+
+	// The stream only holds the packets above, the rest of the registry still needs a handler
+	template<typename PacketType>
+	void OnPacket(const PacketType&) { Sink += PacketType::Id; }
+};
+
+template<typename Packet>
+DispatchResult DecodeAndHandle(CountingHandler& handler, const uint8_t* data, size_t size)
+{
+	Packet packet;
+	if (!GamePacketRegistry::Decode(packet, data, size))
+	{
+		return DispatchResult::Malformed;
+	}
+	handler.OnPacket(packet);
+	return DispatchResult::Ok;
+}
+
+DispatchResult SwitchDispatch(CountingHandler& handler, const uint8_t* data, size_t size)
+{
+	switch (data[0])
+	{
+	case EntityReplicationPacket::Id: return DecodeAndHandle<EntityReplicationPacket>(handler, data, size);
+	case ConnectionRequestPacket::Id: return DecodeAndHandle<ConnectionRequestPacket>(handler, data, size);
+	case ConnectionResponsePacket::Id: return DecodeAndHandle<ConnectionResponsePacket>(handler, data, size);
+	default: return DispatchResult::Unknown;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const size_t packetCount = argc > 1 ? std::atoi(argv[1]) : 1000000;
+	const int roundCount = argc > 2 ? std::atoi(argv[2]) : 10;
+
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<int> kind(0, 9);
+	std::uniform_int_distribution<int> count(0, 8);
+
+	// Mostly small replication packets, like a server streaming to a client
+	EntityReplicationPacket replication;
+	for (int i = 0; i < 8; ++i)
+	{
+		replication.Entered.Push(i);
+		replication.Left.Push(i + 100);
+	}
+
+	ConnectionResponsePacket response;
+	response.Status = (uint8_t)ConnectionStatus::Accepted;
+	response.ClientIdentifier = 7;
+
+	GamePacketRegistry registry;
+	std::vector<uint8_t> stream;
+	std::vector<std::pair<size_t, size_t>> packets; // offset, size
+	stream.reserve(packetCount * 64);
+	packets.reserve(packetCount);
+
+	std::array<uint8_t, MAX_PACKET_SIZE> buffer;
+	auto encodeStart = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < packetCount; ++i)
+	{
+		size_t size = 0;
+		int k = kind(rng);
+		if (k < 8)
+		{
+			replication.Entered.Count = (uint16_t)count(rng);
+			replication.Left.Count = (uint16_t)count(rng);
+			replication.Updates.Clear();
+			for (int u = count(rng); u > 0; --u)
+			{
+				replication.Updates.Push(EntityState{ (uint32_t)u, (float)u, (float)-u });
+			}
+			size = registry.Encode(replication, buffer.data(), buffer.size());
+		}
+		else if (k == 8)
+		{
+			size = registry.Encode(ConnectionRequestPacket(), buffer.data(), buffer.size());
+		}
+		else
+		{
+			size = registry.Encode(response, buffer.data(), buffer.size());
+		}
+
+		packets.emplace_back(stream.size(), size);
+		stream.insert(stream.end(), buffer.data(), buffer.data() + size);
+	}
+	double encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - encodeStart).count();
+
+	CountingHandler registryHandler;
+	auto registryStart = std::chrono::steady_clock::now();
+	for (int round = 0; round < roundCount; ++round)
+	{
+		for (const auto& packet : packets)
+		{
+			if (registry.Dispatch(registryHandler, stream.data() + packet.first, packet.second) != DispatchResult::Ok)
+			{
+				std::cout << "Error: dispatch failed" << std::endl;
+				return 1;
+			}
+		}
+	}
+	double registrySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - registryStart).count();
+
+	CountingHandler switchHandler;
+	auto switchStart = std::chrono::steady_clock::now();
+	for (int round = 0; round < roundCount; ++round)
+	{
+		for (const auto& packet : packets)
+		{
+			if (SwitchDispatch(switchHandler, stream.data() + packet.first, packet.second) != DispatchResult::Ok)
+			{
+				std::cout << "Error: dispatch failed" << std::endl;
+				return 1;
+			}
+		}
+	}
+	double switchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - switchStart).count();
+
+	const double dispatched = (double)packetCount * roundCount;
+	std::cout << "packets:           " << packetCount << " (" << stream.size() << " bytes)" << std::endl;
+	std::cout << "encode:            " << encodeSeconds * 1e9 / packetCount << " ns/packet" << std::endl;
+	std::cout << "registry dispatch: " << registrySeconds * 1e9 / dispatched << " ns/packet, " << dispatched / registrySeconds / 1e6 << " Mpackets/s" << std::endl;
+	std::cout << "switch dispatch:   " << switchSeconds * 1e9 / dispatched << " ns/packet, " << dispatched / switchSeconds / 1e6 << " Mpackets/s" << std::endl;
+	std::cout << "received (replication): " << registry.GetCounters<EntityReplicationPacket>().Received << std::endl;
+	std::cout << "checksum:          " << registryHandler.Sink << " / " << switchHandler.Sink << std::endl;
+
+	return registryHandler.Sink == switchHandler.Sink ? 0 : 1;
+}
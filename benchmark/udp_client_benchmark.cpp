@@ -0,0 +1,109 @@
+// Fires many concurrent probes through one evpp::udp::Client at a loopback
+// echo evpp::udp::Server and reports the throughput and the round trip times.
+// The round trip times start when DoRequest is called, so they include the time
+// a probe waits in the client queue behind max_in_flight others.
+//
+// Usage: HelloEvppUdpClientBenchmark [probe_count=10000] [port=1054] [payload_size=32] [max_in_flight=64]
+
+#include <evpp/udp/udp_server.h>
+#include <evpp/udp/udp_client.h>
+#include <evpp/event_loop.h>
+#include <evpp/event_loop_thread.h>
+#include <evpp/timestamp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+#ifdef _WIN32
+	WSADATA wsadata;
+	if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
+	{
+		std::cout << "Error: Failed to initialize winsock API." << std::endl;
+		return 1;
+	}
+#endif
+
+	const int probeCount = argc > 1 ? std::atoi(argv[1]) : 10000;
+	const int port = argc > 2 ? std::atoi(argv[2]) : 1054;
+	const size_t payloadSize = argc > 3 ? std::atoi(argv[3]) : 32;
+	const size_t maxInFlight = argc > 4 ? std::atoi(argv[4]) : 64;
+
+	evpp::udp::Server server;
+	server.SetMessageHandler([](evpp::EventLoop*, evpp::udp::MessagePtr& msg) { evpp::udp::SendMessage(msg); });
+	if (!server.Init(port) || !server.Start())
+	{
+		std::cout << "Error: Failed to start the echo server on port " << port << std::endl;
+		return 1;
+	}
+
+	evpp::EventLoopThread loopThread;
+	loopThread.Start(true);
+
+	evpp::udp::Client client(loopThread.loop(), "127.0.0.1:" + std::to_string(port));
+	client.set_max_retries(3);
+	client.set_max_in_flight(maxInFlight);
+	if (!client.Connect())
+	{
+		std::cout << "Error: Failed to connect the client" << std::endl;
+		return 1;
+	}
+
+	// Only touched in the client loop thread
+	std::vector<double> rttMicros;
+	rttMicros.reserve(probeCount);
+	std::atomic<int> finished(0);
+	std::atomic<int> timedOut(0);
+	std::atomic<int> mismatched(0);
+
+	const std::string payload(payloadSize, 'x');
+	evpp::Timestamp start = evpp::Timestamp::Now();
+	for (int i = 0; i < probeCount; ++i)
+	{
+		evpp::Timestamp sentAt = evpp::Timestamp::Now();
+		client.DoRequest(payload, evpp::Duration(0.2), [&, sentAt](const evpp::Slice& response, bool timeout)
+		{
+			if (timeout)
+			{
+				timedOut++;
+			}
+			else if (response.ToString() != payload)
+			{
+				mismatched++;
+			}
+			else
+			{
+				rttMicros.push_back((evpp::Timestamp::Now() - sentAt).Microseconds());
+			}
+			finished++;
+		});
+	}
+
+	while (finished.load() < probeCount)
+	{
+		usleep(1000);
+	}
+	double elapsed = (evpp::Timestamp::Now() - start).Seconds();
+
+	client.Close();
+	loopThread.Stop(true);
+	server.Stop(true);
+
+	std::sort(rttMicros.begin(), rttMicros.end());
+	auto percentile = [&](double p) { return rttMicros.empty() ? 0.0 : rttMicros[std::min(rttMicros.size() - 1, (size_t)(p * rttMicros.size()))]; };
+
+	std::cout << "probes:        " << probeCount << " (" << maxInFlight << " in flight)" << std::endl;
+	std::cout << "answered:      " << rttMicros.size() << std::endl;
+	std::cout << "timed out:     " << timedOut.load() << std::endl;
+	std::cout << "mismatched:    " << mismatched.load() << std::endl;
+	std::cout << "datagrams out: " << client.sent_count() << " (" << client.retransmit_count() << " retransmits)" << std::endl;
+	std::cout << "elapsed:       " << elapsed << " s" << std::endl;
+	std::cout << "probes/s:      " << probeCount / elapsed << std::endl;
+	std::cout << "latency p50/p99 (incl. queueing): " << percentile(0.50) << " / " << percentile(0.99) << " us" << std::endl;
+
+	return 0;
+}
@@ -4,6 +4,7 @@
 #include <signal.h>
 #include <iostream>
 #include <array>
+#include <chrono>
 
 #ifndef _WIN32
 #include <netinet/in.h>
@@ -19,6 +20,8 @@
 #include <event2/util.h>
 #include <event2/event.h>
 
+#include "packets.h"
+
 void cb_func(evutil_socket_t fd, short what, void* arg);
 void writecb(struct bufferevent*, void*);
 void readcb(struct bufferevent*, void*);
@@ -95,7 +98,44 @@ int main(int argc, char** argv)
 }
 
 #include <vector>
-#include <bitset>
+
+GamePacketRegistry GamePackets;
+
+// Only the server sends to us
+Reassembler Reassembly(1, 8, MAX_MESSAGE_SIZE, MAX_PACKET_SIZE, 1000);
+
+struct ClientPacketHandler
+{
+	void OnPacket(const ConnectionResponsePacket& response)
+	{
+		if (response.Status == (uint8_t)ConnectionStatus::Accepted)
+		{
+			std::cout << "handling connection accepted" << std::endl;
+			std::cout << "myid: " << response.ClientIdentifier << std::endl;
+		}
+		else if (response.Status == (uint8_t)ConnectionStatus::Denied)
+		{
+			std::cout << "handling connection denied" << std::endl;
+		}
+		else
+		{
+			std::cout << "handling unknown status code" << std::endl;
+		}
+	}
+
+	void OnPacket(const EntityReplicationPacket& replication)
+	{
+		std::cout << "handling replication: " << replication.Entered.Size() << " entered, " << replication.Left.Size() << " left, "
+			<< replication.Updates.Size() << " updates" << std::endl;
+	}
+
+	// Packets only the client sends
+	template<typename PacketType>
+	void OnPacket(const PacketType&)
+	{
+		std::cout << "unexpected packet " << (int)PacketType::Id << std::endl;
+	}
+};
 
 void cb_func(evutil_socket_t fd, short what, void* arg)
 {
@@ -119,30 +159,26 @@ void cb_func(evutil_socket_t fd, short what, void* arg)
 	{
 		// About MSG_CONFIRM: https://stackoverflow.com/questions/16594387/why-should-i-use-or-not-use-msg-confirm
 
-		uint8_t data = 2; // mode
-		sendto(fd, (const char*)&data, sizeof(data), 0, (const sockaddr*)&servaddr, sizeof(servaddr));
-		
-		std::bitset<8> bs(data);
-		std::cout << "sending data:" << bs << std::endl;;
+		std::array<uint8_t, MAX_PACKET_SIZE> buffer;
+		size_t size = GamePackets.Encode(ConnectionRequestPacket(), buffer.data(), buffer.size());
+		sendto(fd, (const char*)buffer.data(), (int)size, 0, (const sockaddr*)&servaddr, sizeof(servaddr));
+
+		std::cout << "sending connection request" << std::endl;
 	}
 
 	if (what & EV_READ)
 	{
-		return;
 		// recvmmsg could improve performance at the cost of a significantly more complex interface
 		//int readn = ::recvfrom(thread->fd(), (char*)recv_msg->WriteBegin(), recv_buf_size_, 0, recv_msg->mutable_remote_addr(), &addr_len);
-		std::array<uint8_t, 1024> buffer;
-		memset(&buffer, 0, sizeof(buffer));
+		std::array<uint8_t, MAX_PACKET_SIZE> buffer;
 
-		// Warn: MSG_WAITALL should block until all data has been received. From the manual page on recv - https://linux.die.net/man/2/recv
 		/*
 		https://linux.die.net/man/3/recvfrom
 		[...] If the address argument is not a null pointer and the protocol provides the source address of messages,
 		the source address of the received message shall be stored in the sockaddr structure pointed to by the address argument,
 		and the length of this address shall be stored in the object pointed to by the address_len argument.
 		*/
-		// int addrlen = sizeof(servaddr);
-		int n = recvfrom(fd, (char*)&buffer, 1024, 0, nullptr, nullptr);
+		int n = recvfrom(fd, (char*)&buffer, (int)buffer.size(), 0, nullptr, nullptr);
 		if (n == SOCKET_ERROR)
 		{
 			std::cout << "Error reading socket" << std::endl;
@@ -152,37 +188,22 @@ void cb_func(evutil_socket_t fd, short what, void* arg)
 
 		// TODO: Security check if is coming from server
 
-		uint8_t mode = reinterpret_cast<uint8_t>(&buffer);
-		if (mode == 0)
-		{
-			std::cout << "handling unreliable package" << std::endl;
-		}
-		else if (mode == 1)
-		{
-			std::cout << "handling reliable package" << std::endl;
-		}
-		else if (mode == 2)
+		const uint8_t* data = buffer.data();
+		size_t size = n;
+		if (IsFragment(data, size))
 		{
-			uint8_t res = reinterpret_cast<uint8_t>(&buffer + sizeof(uint8_t));
-
-			if (res == 0) // connection denied
-			{
-				std::cout << "handling connection denied" << std::endl;
-			}
-			else if (res == 1) // connection accepted
+			int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			if (!Reassembly.Add(0, buffer.data(), n, nowMs, data, size))
 			{
-				std::cout << "handling connection accepted" << std::endl;
-				uint8_t myid = reinterpret_cast<uint8_t>(&buffer + (sizeof(uint8_t) * 2));
-				std::cout << "myid: " << (int)myid << std::endl;
-			}
-			else
-			{
-				std::cout << "handling unknown status code" << std::endl;
+				return;
 			}
 		}
-		else
+
+		ClientPacketHandler handler;
+		DispatchResult result = GamePackets.Dispatch(handler, data, size);
+		if (result != DispatchResult::Ok)
 		{
-			std::cout << "handling unknown mode: " << (int)mode << std::endl;
+			std::cout << "dropped " << (result == DispatchResult::Unknown ? "unknown" : "malformed") << " packet of " << n << " bytes" << std::endl;
 		}
 	}
 }
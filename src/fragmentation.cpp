@@ -0,0 +1,189 @@
+#include "fragmentation.h"
+
+#include <cassert>
+
+const uint32_t Reassembler::CompletionsPerClient;
+
+Fragmenter::Fragmenter(size_t maxDatagramSize)
+	: PayloadSize(maxDatagramSize - FragmentHeaderSize), Buffer(maxDatagramSize)
+{
+	assert(maxDatagramSize > FragmentHeaderSize);
+}
+
+size_t Fragmenter::GetFragmentCount(size_t size) const
+{
+	const size_t count = (size + PayloadSize - 1) / PayloadSize;
+	return count <= MaxFragmentCount ? count : 0;
+}
+
+Reassembler::Reassembler(uint16_t maxClients, uint32_t slotsPerClient, size_t maxMessageSize, size_t maxDatagramSize, int64_t timeoutMs)
+	: SlotsPerClient(slotsPerClient)
+	, MaxMessageSize(maxMessageSize)
+	, PayloadSize(maxDatagramSize - FragmentHeaderSize)
+	, TimeoutMs(timeoutMs)
+	, Slots((size_t)maxClients * slotsPerClient)
+	, Storage((size_t)maxClients * slotsPerClient * maxMessageSize)
+	, Completions((size_t)maxClients * CompletionsPerClient)
+	, NextCompletion(maxClients, 0)
+{
+	assert(maxDatagramSize > FragmentHeaderSize);
+	assert(slotsPerClient > 0);
+}
+
+bool Reassembler::Add(uint16_t client, const uint8_t* fragment, size_t size, int64_t nowMs, const uint8_t*& message, size_t& messageSize)
+{
+	if ((size_t)client * SlotsPerClient >= Slots.size() || !IsFragment(fragment, size))
+	{
+		Stats.Rejected++;
+		return false;
+	}
+
+	const uint16_t messageId = (uint16_t)((fragment[1] << 8) | fragment[2]);
+	const uint8_t index = fragment[3];
+	const uint8_t count = fragment[4];
+	const uint8_t* payload = fragment + FragmentHeaderSize;
+	const size_t length = size - FragmentHeaderSize;
+
+	// Only the last fragment may be short, and the message must fit in a slot
+	const bool last = index + 1 == count;
+	if (index >= count || length > PayloadSize || (!last && length != PayloadSize)
+		|| (count - 1) * PayloadSize + (last ? length : 1) > MaxMessageSize)
+	{
+		Stats.Rejected++;
+		return false;
+	}
+
+	// Nothing to reassemble
+	if (count == 1)
+	{
+		Stats.Completed++;
+		message = payload;
+		messageSize = length;
+		return true;
+	}
+
+	if (IsCompleted(client, messageId, count, nowMs))
+	{
+		Stats.Duplicates++;
+		return false;
+	}
+
+	Slot* slot = FindSlot(client, messageId, count, nowMs);
+	if (slot->Have[index])
+	{
+		Stats.Duplicates++;
+		return false;
+	}
+
+	uint8_t* storage = Storage.data() + (size_t)(slot - Slots.data()) * MaxMessageSize;
+	memcpy(storage + index * PayloadSize, payload, length);
+	slot->Have[index] = true;
+	slot->Received++;
+	if (last)
+	{
+		slot->LastSize = length;
+	}
+
+	if (slot->Received < slot->Count)
+	{
+		return false;
+	}
+
+	slot->Active = false;
+	Stats.Completed++;
+
+	uint8_t& next = NextCompletion[client];
+	Completions[(size_t)client * CompletionsPerClient + next] = Completion{ messageId, count, nowMs };
+	next = (uint8_t)((next + 1) % CompletionsPerClient);
+
+	message = storage;
+	messageSize = (slot->Count - 1) * PayloadSize + slot->LastSize;
+	return true;
+}
+
+Reassembler::Slot* Reassembler::FindSlot(uint16_t client, uint16_t messageId, uint8_t count, int64_t nowMs)
+{
+	Slot* begin = Slots.data() + (size_t)client * SlotsPerClient;
+	Slot* end = begin + SlotsPerClient;
+
+	Slot* free = nullptr;
+	Slot* oldest = begin;
+	for (Slot* slot = begin; slot != end; ++slot)
+	{
+		if (slot->Active && nowMs - slot->StartMs > TimeoutMs)
+		{
+			slot->Active = false;
+			Stats.Expired++;
+		}
+
+		if (!slot->Active)
+		{
+			free = free ? free : slot;
+			continue;
+		}
+
+		// A reused message id with another count belongs to a new message
+		if (slot->MessageId == messageId && slot->Count == count)
+		{
+			return slot;
+		}
+
+		if (slot->StartMs < oldest->StartMs)
+		{
+			oldest = slot;
+		}
+	}
+
+	if (!free)
+	{
+		free = oldest;
+		Stats.Evicted++;
+	}
+
+	free->Active = true;
+	free->MessageId = messageId;
+	free->Count = count;
+	free->Received = 0;
+	free->LastSize = 0;
+	free->StartMs = nowMs;
+	free->Have.reset();
+	return free;
+}
+
+bool Reassembler::IsCompleted(uint16_t client, uint16_t messageId, uint8_t count, int64_t nowMs) const
+{
+	const Completion* begin = Completions.data() + (size_t)client * CompletionsPerClient;
+	for (const Completion* completion = begin; completion != begin + CompletionsPerClient; ++completion)
+	{
+		// After the timeout the id may belong to a new message
+		if (completion->Count == count && completion->MessageId == messageId && nowMs - completion->CompletedMs <= TimeoutMs)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void Reassembler::Expire(int64_t nowMs)
+{
+	for (Slot& slot : Slots)
+	{
+		if (slot.Active && nowMs - slot.StartMs > TimeoutMs)
+		{
+			slot.Active = false;
+			Stats.Expired++;
+		}
+	}
+}
+
+void Reassembler::RemoveClient(uint16_t client)
+{
+	Slot* begin = Slots.data() + (size_t)client * SlotsPerClient;
+	for (Slot* slot = begin; slot != begin + SlotsPerClient; ++slot)
+	{
+		slot->Active = false;
+	}
+
+	Completion* completions = Completions.data() + (size_t)client * CompletionsPerClient;
+	std::fill(completions, completions + CompletionsPerClient, Completion());
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Application level fragmentation, so that messages larger than one datagram
+// never rely on IP fragmentation, where losing any piece loses the whole datagram
+// and the receive buffer is silently truncated.
+//
+// A fragment is a datagram of its own:
+//
+//	uint8_t  FragmentPacketId
+//	uint16_t MessageId   network byte order
+//	uint8_t  Index
+//	uint8_t  Count
+//	         payload     every fragment but the last one is full
+//
+// FragmentPacketId is reserved, it must not be used by a packet type.
+
+const uint8_t FragmentPacketId = 0xFF;
+const size_t FragmentHeaderSize = 5;
+const size_t MaxFragmentCount = 255;
+
+inline bool IsFragment(const uint8_t* data, size_t size)
+{
+	return size > FragmentHeaderSize && data[0] == FragmentPacketId;
+}
+
+class Fragmenter
+{
+public:
+	explicit Fragmenter(size_t maxDatagramSize);
+
+	size_t GetPayloadSize() const { return PayloadSize; }
+
+	// 0 if the message is empty or needs more than MaxFragmentCount fragments.
+	size_t GetFragmentCount(size_t size) const;
+
+	// Invokes emit(fragment, fragmentSize) for every fragment of the message, the fragment is only
+	// valid during the call. Returns false if the message cannot be fragmented.
+	template<typename Fn>
+	bool Split(const uint8_t* data, size_t size, Fn&& emit)
+	{
+		const size_t count = GetFragmentCount(size);
+		if (count == 0)
+		{
+			return false;
+		}
+
+		const uint16_t messageId = NextMessageId++;
+		for (size_t index = 0; index < count; ++index)
+		{
+			const size_t offset = index * PayloadSize;
+			const size_t length = std::min(PayloadSize, size - offset);
+
+			Buffer[0] = FragmentPacketId;
+			Buffer[1] = (uint8_t)(messageId >> 8);
+			Buffer[2] = (uint8_t)messageId;
+			Buffer[3] = (uint8_t)index;
+			Buffer[4] = (uint8_t)count;
+			memcpy(Buffer.data() + FragmentHeaderSize, data + offset, length);
+			emit(Buffer.data(), FragmentHeaderSize + length);
+		}
+		return true;
+	}
+
+private:
+	size_t PayloadSize;
+	uint16_t NextMessageId = 0;
+	std::vector<uint8_t> Buffer;
+};
+
+struct ReassemblyStats
+{
+	uint64_t Completed = 0;
+	uint64_t Expired = 0;    // Timed out before all the fragments arrived
+	uint64_t Evicted = 0;    // Dropped for a newer message because all the client's slots were in use
+	uint64_t Duplicates = 0;
+	uint64_t Rejected = 0;   // Malformed, or larger than the maximum message size
+};
+
+// Reassembles fragmented messages in a pool allocated up front: every client
+// owns slotsPerClient slots of maxMessageSize bytes. Memory use never grows
+// after construction, whatever the peers send, and a client can only ever
+// evict its own incomplete messages. A message has timeout milliseconds from
+// its first fragment to complete, so trickling fragments cannot pin a slot.
+// The fragments of the last few messages a client completed count as
+// duplicates for as long, so late copies cannot take a slot either.
+class Reassembler
+{
+public:
+	Reassembler(uint16_t maxClients, uint32_t slotsPerClient, size_t maxMessageSize, size_t maxDatagramSize, int64_t timeoutMs);
+
+	// Returns true when the fragment completes a message. message then points to it, it is
+	// valid until the next call for the same client.
+	bool Add(uint16_t client, const uint8_t* fragment, size_t size, int64_t nowMs, const uint8_t*& message, size_t& messageSize);
+
+	// Frees the slots of the messages older than the timeout.
+	void Expire(int64_t nowMs);
+
+	void RemoveClient(uint16_t client);
+
+	const ReassemblyStats& GetStats() const { return Stats; }
+	size_t GetMemoryUsage() const { return Storage.size(); }
+
+private:
+	struct Slot
+	{
+		bool Active = false;
+		uint16_t MessageId = 0;
+		uint8_t Count = 0;
+		uint16_t Received = 0;
+		size_t LastSize = 0;
+		int64_t StartMs = 0;
+		std::bitset<MaxFragmentCount> Have;
+	};
+
+	// A message completed recently, Count is 0 for an unused entry
+	struct Completion
+	{
+		uint16_t MessageId = 0;
+		uint8_t Count = 0;
+		int64_t CompletedMs = 0;
+	};
+	static const uint32_t CompletionsPerClient = 8;
+
+	Slot* FindSlot(uint16_t client, uint16_t messageId, uint8_t count, int64_t nowMs);
+	bool IsCompleted(uint16_t client, uint16_t messageId, uint8_t count, int64_t nowMs) const;
+
+private:
+	uint32_t SlotsPerClient;
+	size_t MaxMessageSize;
+	size_t PayloadSize;
+	int64_t TimeoutMs;
+
+	// Indexed by client * SlotsPerClient + slot, Storage holds MaxMessageSize bytes per slot
+	std::vector<Slot> Slots;
+	std::vector<uint8_t> Storage;
+
+	// Indexed by client * CompletionsPerClient + entry, NextCompletion is the entry each client overwrites next
+	std::vector<Completion> Completions;
+	std::vector<uint8_t> NextCompletion;
+
+	ReassemblyStats Stats;
+};
@@ -0,0 +1,309 @@
+#include "interest.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// How many times more often the closest entities are sent compared to the ones at the edge of the view
+static const float DistancePriorityWeight = 3.0f;
+
+const uint32_t SpatialGrid::InvalidEntity;
+
+SpatialGrid::SpatialGrid(float cellSize, uint32_t maxEntities, uint32_t bucketCount)
+	: CellSize(cellSize), InvCellSize(1.0f / cellSize)
+{
+	assert(cellSize > 0.0f);
+	assert(bucketCount > 0 && (bucketCount & (bucketCount - 1)) == 0);
+
+	BucketMask = bucketCount - 1;
+	Buckets.resize(bucketCount);
+	Cell.resize(maxEntities, 0);
+	SlotInBucket.resize(maxEntities, InvalidEntity);
+}
+
+// Cell coordinates saturate here, far from int32 overflow, also in the loops of Query
+static const float MaxCellCoord = 1073741824.0f;
+
+int32_t SpatialGrid::CellCoord(float v) const
+{
+	const float c = std::floor(v * InvCellSize);
+	if (!(c > -MaxCellCoord))
+	{
+		// Also NaN
+		return -static_cast<int32_t>(MaxCellCoord);
+	}
+	return static_cast<int32_t>(std::min(c, MaxCellCoord));
+}
+
+uint32_t SpatialGrid::Bucket(uint64_t cell) const
+{
+	// Fibonacci hashing, spreads neighbouring cells over the buckets
+	return static_cast<uint32_t>((cell * 11400714819323198485ull) >> 40) & BucketMask;
+}
+
+bool SpatialGrid::Set(uint32_t entity, float x, float y)
+{
+	if (entity >= Cell.size())
+	{
+		return false;
+	}
+
+	const uint64_t cell = PackCell(CellCoord(x), CellCoord(y));
+	if (SlotInBucket[entity] != InvalidEntity)
+	{
+		if (Cell[entity] == cell)
+		{
+			Entry& entry = Buckets[Bucket(cell)][SlotInBucket[entity]];
+			entry.X = x;
+			entry.Y = y;
+			return true;
+		}
+		Unlink(entity);
+	}
+
+	std::vector<Entry>& bucket = Buckets[Bucket(cell)];
+	Cell[entity] = cell;
+	SlotInBucket[entity] = static_cast<uint32_t>(bucket.size());
+	bucket.push_back(Entry{ cell, x, y, entity });
+	return true;
+}
+
+float SpatialGrid::GetX(uint32_t entity) const
+{
+	return Contains(entity) ? Buckets[Bucket(Cell[entity])][SlotInBucket[entity]].X : 0.0f;
+}
+
+float SpatialGrid::GetY(uint32_t entity) const
+{
+	return Contains(entity) ? Buckets[Bucket(Cell[entity])][SlotInBucket[entity]].Y : 0.0f;
+}
+
+void SpatialGrid::Remove(uint32_t entity)
+{
+	if (Contains(entity))
+	{
+		Unlink(entity);
+	}
+}
+
+void SpatialGrid::Unlink(uint32_t entity)
+{
+	// Swap with the last entry of the bucket
+	std::vector<Entry>& bucket = Buckets[Bucket(Cell[entity])];
+	const uint32_t slot = SlotInBucket[entity];
+	bucket[slot] = bucket.back();
+	SlotInBucket[bucket[slot].Entity] = slot;
+	bucket.pop_back();
+	SlotInBucket[entity] = InvalidEntity;
+}
+
+///
+
+InterestManager::InterestManager(float cellSize, float viewRadius, uint32_t maxEntities, uint16_t maxClients)
+	: Grid(cellSize, maxEntities), ViewRadius(viewRadius)
+{
+	Importance.resize(maxEntities, 1.0f);
+	Clients.resize(maxClients);
+}
+
+bool InterestManager::SetEntity(uint32_t entity, float x, float y, float importance)
+{
+	if (!Grid.Set(entity, x, y))
+	{
+		return false;
+	}
+	Importance[entity] = importance;
+	return true;
+}
+
+void InterestManager::RemoveEntity(uint32_t entity)
+{
+	// Clients see it leave on the next Update()
+	Grid.Remove(entity);
+}
+
+bool InterestManager::SetClient(uint16_t client, float x, float y)
+{
+	if (client >= Clients.size())
+	{
+		return false;
+	}
+
+	ClientView& view = Clients[client];
+	view.Active = true;
+	view.X = x;
+	view.Y = y;
+	return true;
+}
+
+void InterestManager::RemoveClient(uint16_t client)
+{
+	if (client >= Clients.size())
+	{
+		return;
+	}
+
+	ClientView& view = Clients[client];
+	view.Active = false;
+	view.Visible.clear();
+	view.Priority.clear();
+	view.Accumulated.clear();
+	view.Announced.clear();
+	view.PendingEnter.clear();
+	view.PendingLeave.clear();
+}
+
+bool InterestManager::RemovePending(std::vector<uint32_t>& pending, uint32_t entity)
+{
+	std::vector<uint32_t>::iterator it = std::find(pending.begin(), pending.end(), entity);
+	if (it == pending.end())
+	{
+		return false;
+	}
+	pending.erase(it);
+	return true;
+}
+
+void InterestManager::Update()
+{
+	const float invViewRadius = 1.0f / ViewRadius;
+
+	for (uint16_t client = 0; client < Clients.size(); ++client)
+	{
+		ClientView& view = Clients[client];
+		if (!view.Active)
+		{
+			continue;
+		}
+
+		QueryResult.clear();
+		Grid.Query(view.X, view.Y, ViewRadius, [this](uint32_t entity, float distanceSquared)
+		{
+			QueryResult.emplace_back(entity, distanceSquared);
+		});
+		std::sort(QueryResult.begin(), QueryResult.end());
+
+		// Merge the sorted old and new sets, the accumulated priority of the entities staying in view is kept
+		NextVisible.clear();
+		NextPriority.clear();
+		NextAccumulated.clear();
+		NextAnnounced.clear();
+
+		// A leave cancels the enter the client was not told about yet
+		auto leave = [&view](size_t index)
+		{
+			if (!view.Announced[index] && RemovePending(view.PendingEnter, view.Visible[index]))
+			{
+				return;
+			}
+			view.PendingLeave.push_back(view.Visible[index]);
+		};
+
+		size_t oldIndex = 0;
+		for (const std::pair<uint32_t, float>& hit : QueryResult)
+		{
+			while (oldIndex < view.Visible.size() && view.Visible[oldIndex] < hit.first)
+			{
+				leave(oldIndex++);
+			}
+
+			float accumulated = 0.0f;
+			uint8_t announced = 0;
+			if (oldIndex < view.Visible.size() && view.Visible[oldIndex] == hit.first)
+			{
+				accumulated = view.Accumulated[oldIndex];
+				announced = view.Announced[oldIndex];
+				oldIndex++;
+			}
+			else if (RemovePending(view.PendingLeave, hit.first))
+			{
+				// Back before the client was told it left, so it still has it
+				announced = 1;
+			}
+			else
+			{
+				view.PendingEnter.push_back(hit.first);
+			}
+
+			const float closeness = 1.0f - std::sqrt(hit.second) * invViewRadius;
+			NextVisible.push_back(hit.first);
+			NextPriority.push_back(Importance[hit.first] * (1.0f + DistancePriorityWeight * closeness));
+			NextAccumulated.push_back(accumulated);
+			NextAnnounced.push_back(announced);
+		}
+
+		while (oldIndex < view.Visible.size())
+		{
+			leave(oldIndex++);
+		}
+
+		view.Visible.swap(NextVisible);
+		view.Priority.swap(NextPriority);
+		view.Accumulated.swap(NextAccumulated);
+		view.Announced.swap(NextAnnounced);
+	}
+}
+
+void InterestManager::TakeVisibilityChanges(uint16_t client, size_t maxEntered, size_t maxLeft, std::vector<uint32_t>& entered, std::vector<uint32_t>& left)
+{
+	if (client >= Clients.size())
+	{
+		return;
+	}
+	ClientView& view = Clients[client];
+
+	const size_t enterCount = std::min(maxEntered, view.PendingEnter.size());
+	for (size_t i = 0; i < enterCount; ++i)
+	{
+		// Pending enters are always visible, a leave would have removed them
+		const uint32_t entity = view.PendingEnter[i];
+		const size_t index = std::lower_bound(view.Visible.begin(), view.Visible.end(), entity) - view.Visible.begin();
+		assert(index < view.Visible.size() && view.Visible[index] == entity);
+		view.Announced[index] = 1;
+		entered.push_back(entity);
+	}
+	view.PendingEnter.erase(view.PendingEnter.begin(), view.PendingEnter.begin() + enterCount);
+
+	const size_t leaveCount = std::min(maxLeft, view.PendingLeave.size());
+	left.insert(left.end(), view.PendingLeave.begin(), view.PendingLeave.begin() + leaveCount);
+	view.PendingLeave.erase(view.PendingLeave.begin(), view.PendingLeave.begin() + leaveCount);
+}
+
+void InterestManager::SelectUpdates(uint16_t client, uint32_t budgetBytes, uint32_t bytesPerEntity, std::vector<uint32_t>& out)
+{
+	if (client >= Clients.size() || bytesPerEntity == 0)
+	{
+		return;
+	}
+	ClientView& view = Clients[client];
+
+	Order.clear();
+	for (uint32_t i = 0; i < view.Visible.size(); ++i)
+	{
+		if (view.Announced[i])
+		{
+			view.Accumulated[i] += view.Priority[i];
+			Order.push_back(i);
+		}
+	}
+
+	const size_t count = std::min<size_t>(Order.size(), budgetBytes / bytesPerEntity);
+	if (count == 0)
+	{
+		return;
+	}
+
+	if (count < Order.size())
+	{
+		std::nth_element(Order.begin(), Order.begin() + count, Order.end(), [&view](uint32_t a, uint32_t b)
+		{
+			return view.Accumulated[a] > view.Accumulated[b];
+		});
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		out.push_back(view.Visible[Order[i]]);
+		view.Accumulated[Order[i]] = 0.0f;
+	}
+}
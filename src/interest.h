@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Uniform spatial hash grid. Entities are bucketed by the cell they are in,
+// cells are hashed into a fixed, power of two, number of buckets so the world
+// does not need bounds. Cell coordinates saturate 2^30 cells from the origin.
+// A cell size around half the query radius works best.
+class SpatialGrid
+{
+public:
+	static const uint32_t InvalidEntity = UINT32_MAX;
+
+public:
+	SpatialGrid(float cellSize, uint32_t maxEntities, uint32_t bucketCount = 4096);
+
+	// Insert the entity, or move it if it is already in the grid.
+	// Returns false if the entity id is out of range.
+	bool Set(uint32_t entity, float x, float y);
+	void Remove(uint32_t entity);
+
+	bool Contains(uint32_t entity) const { return entity < Cell.size() && SlotInBucket[entity] != InvalidEntity; }
+	// 0 for an entity which is not in the grid
+	float GetX(uint32_t entity) const;
+	float GetY(uint32_t entity) const;
+	float GetCellSize() const { return CellSize; }
+
+	// Invokes fn(entity, distanceSquared) for every entity within radius of (x, y).
+	template<typename Fn>
+	void Query(float x, float y, float radius, Fn&& fn) const
+	{
+		const float radiusSquared = radius * radius;
+		const int32_t minX = CellCoord(x - radius), maxX = CellCoord(x + radius);
+		const int32_t minY = CellCoord(y - radius), maxY = CellCoord(y + radius);
+
+		for (int32_t cy = minY; cy <= maxY; ++cy)
+		{
+			for (int32_t cx = minX; cx <= maxX; ++cx)
+			{
+				const uint64_t cell = PackCell(cx, cy);
+				for (const Entry& entry : Buckets[Bucket(cell)])
+				{
+					// Other cells may share this bucket
+					if (entry.Cell != cell)
+					{
+						continue;
+					}
+
+					const float dx = entry.X - x, dy = entry.Y - y;
+					const float distanceSquared = dx * dx + dy * dy;
+					if (distanceSquared <= radiusSquared)
+					{
+						fn(entry.Entity, distanceSquared);
+					}
+				}
+			}
+		}
+	}
+
+private:
+	int32_t CellCoord(float v) const;
+	static uint64_t PackCell(int32_t cx, int32_t cy) { return (uint64_t(uint32_t(cx)) << 32) | uint32_t(cy); }
+	uint32_t Bucket(uint64_t cell) const;
+	void Unlink(uint32_t entity);
+
+private:
+	// Everything a query needs is stored inline, so scanning a bucket reads one contiguous array
+	struct Entry
+	{
+		uint64_t Cell;
+		float X;
+		float Y;
+		uint32_t Entity;
+	};
+
+private:
+	float CellSize;
+	float InvCellSize;
+	uint32_t BucketMask;
+
+	std::vector<std::vector<Entry>> Buckets;
+
+	// Indexed by entity
+	std::vector<uint64_t> Cell;
+	std::vector<uint32_t> SlotInBucket;
+};
+
+// Area of interest management on top of SpatialGrid.
+//
+// Every Update() recomputes the set of entities each client can see and
+// queues the differences with the previous tick as enter/leave events, so
+// replication only has to create and destroy what changed. The queues are
+// drained by TakeVisibilityChanges() as fast as the packets allow. An entity
+// which comes back before its leave is taken cancels the leave, and one which
+// goes away before its enter is taken cancels the enter, so an entity is
+// never in both queues.
+//
+// SelectUpdates() spends a per client byte budget on the visible entities.
+// Each entity accumulates its priority every tick until it is sent, closer
+// and more important entities accumulate faster and so are sent more often.
+// Only the entities whose enter was taken are selected, a client is never
+// sent an update for an entity it has not been told about.
+class InterestManager
+{
+public:
+	InterestManager(float cellSize, float viewRadius, uint32_t maxEntities, uint16_t maxClients);
+
+	// Return false if the id is out of range
+	bool SetEntity(uint32_t entity, float x, float y, float importance = 1.0f);
+	void RemoveEntity(uint32_t entity);
+
+	bool SetClient(uint16_t client, float x, float y);
+	void RemoveClient(uint16_t client);
+
+	void Update();
+
+	// Moves up to maxEntered queued enters and maxLeft queued leaves of the client to entered and left.
+	void TakeVisibilityChanges(uint16_t client, size_t maxEntered, size_t maxLeft, std::vector<uint32_t>& entered, std::vector<uint32_t>& left);
+
+	// Appends the entities to send to the client this tick to out.
+	void SelectUpdates(uint16_t client, uint32_t budgetBytes, uint32_t bytesPerEntity, std::vector<uint32_t>& out);
+
+	const SpatialGrid& GetGrid() const { return Grid; }
+
+	// Sorted by entity id
+	const std::vector<uint32_t>& GetVisible(uint16_t client) const { return Clients[client].Visible; }
+
+private:
+	struct ClientView
+	{
+		bool Active = false;
+		float X = 0.0f;
+		float Y = 0.0f;
+
+		// Parallel arrays, sorted by entity id
+		std::vector<uint32_t> Visible;
+		std::vector<float> Priority;
+		std::vector<float> Accumulated;
+		std::vector<uint8_t> Announced; // The enter was taken
+
+		// In the order of the events
+		std::vector<uint32_t> PendingEnter;
+		std::vector<uint32_t> PendingLeave;
+	};
+
+private:
+	static bool RemovePending(std::vector<uint32_t>& pending, uint32_t entity);
+
+private:
+	SpatialGrid Grid;
+	float ViewRadius;
+	std::vector<float> Importance;
+	std::vector<ClientView> Clients;
+
+	// Scratch space reused across clients and ticks
+	std::vector<std::pair<uint32_t, float>> QueryResult;
+	std::vector<uint32_t> NextVisible;
+	std::vector<float> NextPriority;
+	std::vector<float> NextAccumulated;
+	std::vector<uint8_t> NextAnnounced;
+	std::vector<uint32_t> Order;
+};
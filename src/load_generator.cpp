@@ -0,0 +1,852 @@
+// Headless load generator for HelloEvppServer.
+//
+// Simulates many clients, each with its own socket so the server sees a distinct address,
+// spread over a number of event loop threads. Every client goes through the connection
+// handshake, sends unreliable and reliable DataPackets at a fixed rate while walking its avatar
+// around with ClientStatePackets, lets the last acknowledgements come back and disconnects.
+// Latency, jitter and loss can be injected in both directions to stress the server on loopback.
+//
+// Usage: HelloEvppLoadGenerator [--server=127.0.0.1:1053] [--clients=100] [--threads=4] [--duration=10]
+//                               [--rate=20] [--size=64] [--reliable=0.1] [--ramp=1]
+//                               [--latency=0] [--jitter=0] [--loss=0]
+//
+//  rate      DataPackets per second and client
+//  size      Payload bytes per DataPacket, at most 1024
+//  reliable  Share of the DataPackets sent as ReliableDataPacket
+//  ramp      Seconds over which the clients start connecting
+//  latency   Milliseconds added to every datagram, in each direction
+//  jitter    Up to this many milliseconds added to or removed from the latency
+//  loss      Percentage of the datagrams dropped, in each direction
+
+#include "packets.h"
+
+#include <evpp/event_loop.h>
+#include <evpp/event_loop_thread.h>
+#include <evpp/fd_channel.h>
+#include <evpp/libevent.h>
+#include <evpp/sockets.h>
+#include <evpp/timestamp.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Options
+{
+	std::string Server = "127.0.0.1:1053";
+	int Clients = 100;
+	int Threads = 4;
+	double Duration = 10.0;
+	double Rate = 20.0;
+	size_t Size = 64;
+	double ReliableShare = 0.1;
+	double Ramp = 1.0;
+	double LatencyMs = 0.0;
+	double JitterMs = 0.0;
+	double LossPercent = 0.0;
+};
+
+const int64_t CONNECT_RETRY_US = 100 * 1000;
+const int64_t CONNECT_TIMEOUT_US = 5 * 1000 * 1000;
+const int64_t RELIABLE_RESEND_US = 200 * 1000;
+const int RELIABLE_MAX_ATTEMPTS = 10;
+const int64_t DRAIN_US = 1000 * 1000; // Wait for the last acknowledgements before disconnecting
+const int DISCONNECT_REPEAT = 3;
+
+// The avatars wander around a square world, so the server's areas of interest overlap and change
+const float WORLD_SIZE = 2048.0f;
+const float AVATAR_SPEED = 64.0f; // Units per second
+const int64_t STATE_INTERVAL_US = 100 * 1000;
+const float PI = 3.14159265f;
+
+int64_t NowUs()
+{
+	return evpp::Timestamp::Now().UnixNano() / 1000;
+}
+
+// Log-linear histogram of microseconds, 16 buckets per power of two so every value is within about 6%.
+class Histogram
+{
+public:
+	void Record(uint64_t value)
+	{
+		Buckets[std::min(Index(value), Buckets.size() - 1)]++;
+		Count++;
+		Max = std::max(Max, value);
+	}
+
+	void Merge(const Histogram& other)
+	{
+		for (size_t i = 0; i < Buckets.size(); ++i)
+		{
+			Buckets[i] += other.Buckets[i];
+		}
+		Count += other.Count;
+		Max = std::max(Max, other.Max);
+	}
+
+	uint64_t Percentile(double p) const
+	{
+		if (Count == 0)
+		{
+			return 0;
+		}
+
+		const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(p * Count + 0.5));
+		uint64_t seen = 0;
+		for (size_t i = 0; i < Buckets.size(); ++i)
+		{
+			seen += Buckets[i];
+			if (seen >= rank)
+			{
+				return std::min(Value(i), Max);
+			}
+		}
+		return Max;
+	}
+
+	uint64_t GetCount() const { return Count; }
+	uint64_t GetMax() const { return Max; }
+
+private:
+	static const size_t SubBuckets = 16;
+
+	static size_t Index(uint64_t value)
+	{
+		if (value < 2 * SubBuckets)
+		{
+			return (size_t)value;
+		}
+
+		size_t shift = 0;
+		while ((value >> shift) >= 2 * SubBuckets)
+		{
+			shift++;
+		}
+		return shift * SubBuckets + (size_t)(value >> shift);
+	}
+
+	// The upper bound of the bucket
+	static uint64_t Value(size_t index)
+	{
+		if (index < 2 * SubBuckets)
+		{
+			return index;
+		}
+
+		const size_t shift = index / SubBuckets - 1;
+		return ((uint64_t)(index - shift * SubBuckets + 1) << shift) - 1;
+	}
+
+private:
+	std::array<uint32_t, 40 * SubBuckets> Buckets = {};
+	uint64_t Count = 0;
+	uint64_t Max = 0;
+};
+
+struct ClientStats
+{
+	uint64_t UnreliableSent = 0;
+	uint64_t UnreliableAcked = 0;
+	uint64_t ReliableSent = 0;
+	uint64_t ReliableAcked = 0;
+	uint64_t ReliableFailed = 0;
+	uint64_t Retransmits = 0;
+	uint64_t ReplicationPackets = 0;
+	uint64_t ReplicatedEntered = 0;
+	uint64_t ReplicatedUpdates = 0;
+	Histogram Rtt;
+	Histogram ReliableDelivery; // From the first send to the acknowledgement, including the retransmits
+};
+
+struct VirtualClient
+{
+	enum class State
+	{
+		Waiting,
+		Connecting,
+		Connected,
+		Draining,
+		Disconnecting,
+		Done,
+	};
+
+	State Status = State::Waiting;
+	bool Accepted = false;
+	bool Denied = false;
+	bool TimedOut = false;
+
+	evpp_socket_t Fd = INVALID_SOCKET;
+	std::unique_ptr<evpp::FdChannel> Channel;
+
+	int64_t StartUs = 0;
+	int64_t ConnectSentUs = 0;
+	int64_t ConnectedUs = 0;
+	int64_t LastTickUs = 0;
+	int DisconnectsSent = 0;
+
+	double SendCredit = 0.0;
+	uint32_t NextSequence = 0;
+
+	float X = 0.0f;
+	float Y = 0.0f;
+	float Heading = 0.0f;
+	int64_t LastStateUs = 0;
+
+	// Unreliable sequences waiting for an acknowledgement, indexed by sequence modulo the size
+	std::array<uint32_t, 1024> Unacked = {};
+
+	struct Pending
+	{
+		int64_t FirstSentUs;
+		int64_t SentUs;
+		int Attempts;
+	};
+	std::map<uint32_t, Pending> ReliablePending;
+
+	ClientStats Stats;
+};
+
+class Worker;
+
+struct LoadPacketHandler
+{
+	Worker& Owner;
+	VirtualClient& Client;
+	int64_t NowUs;
+
+	void OnPacket(const ConnectionResponsePacket& response);
+	void OnPacket(const DataAckPacket& ack);
+	void OnPacket(const EntityReplicationPacket& replication);
+
+	// Everything only the clients send
+	template<typename PacketType>
+	void OnPacket(const PacketType&) {}
+};
+
+class Worker
+{
+public:
+	Worker(const Options& options, const sockaddr_storage& server, uint32_t seed)
+		: Opts(options), Server(server), Rng(seed)
+	{
+		UnreliableData.Payload.Items.fill(0xAB);
+		ReliableData.Payload.Items.fill(0xAB);
+	}
+
+	void AddClient(int64_t startUs)
+	{
+		Clients.emplace_back(new VirtualClient());
+		VirtualClient& client = *Clients.back();
+		client.StartUs = startUs;
+		client.X = (float)(Chance(Rng) * WORLD_SIZE);
+		client.Y = (float)(Chance(Rng) * WORLD_SIZE);
+		client.Heading = (float)(Chance(Rng) * 2.0 * PI);
+	}
+
+	bool Start()
+	{
+		for (auto& client : Clients)
+		{
+			client->Fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+			if (client->Fd == INVALID_SOCKET || evutil_make_socket_nonblocking(client->Fd) < 0
+				|| ::connect(client->Fd, evpp::sock::sockaddr_cast(&Server), sizeof(struct sockaddr_in)) != 0)
+			{
+				std::cout << "Error: Failed to create a client socket, errno=" << errno << std::endl;
+				return false;
+			}
+		}
+
+		Thread.Start(true);
+		Thread.loop()->RunInLoop([this]()
+		{
+			for (auto& client : Clients)
+			{
+				VirtualClient* c = client.get();
+				c->Channel.reset(new evpp::FdChannel(Thread.loop(), c->Fd, true, false));
+				c->Channel->SetReadCallback([this, c]() { HandleRead(*c); });
+				c->Channel->AttachToLoop();
+			}
+			TickTimer = Thread.loop()->RunEvery(evpp::Duration(0.001), [this]() { Tick(); });
+		});
+		return true;
+	}
+
+	bool IsDone() const { return Done.load(); }
+
+	void Stop()
+	{
+		Thread.Stop(true);
+		for (auto& client : Clients)
+		{
+			EVUTIL_CLOSESOCKET(client->Fd);
+		}
+	}
+
+	const std::vector<std::unique_ptr<VirtualClient>>& GetClients() const { return Clients; }
+	const Histogram& GetConnectLatency() const { return ConnectLatency; }
+	const GamePacketRegistry& GetPackets() const { return Packets; }
+
+	std::atomic<uint64_t> DatagramsSent{ 0 };
+	std::atomic<uint64_t> DatagramsReceived{ 0 };
+	std::atomic<uint64_t> InjectedDrops{ 0 };
+	std::atomic<uint64_t> SendErrors{ 0 };
+
+private:
+	friend struct LoadPacketHandler;
+
+	struct Delayed
+	{
+		int64_t DueUs;
+		VirtualClient* Client;
+		bool Inbound;
+		std::string Data;
+
+		bool operator>(const Delayed& other) const { return DueUs > other.DueUs; }
+	};
+
+	// Returns false if the datagram is dropped, otherwise sets the injected delay
+	bool Inject(int64_t& delayUs)
+	{
+		if (Opts.LossPercent > 0 && Chance(Rng) * 100.0 < Opts.LossPercent)
+		{
+			InjectedDrops.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		double delayMs = Opts.LatencyMs;
+		if (Opts.JitterMs > 0)
+		{
+			delayMs += (Chance(Rng) * 2.0 - 1.0) * Opts.JitterMs;
+		}
+		delayUs = std::max<int64_t>(0, (int64_t)(delayMs * 1000.0));
+		return true;
+	}
+
+	template<typename PacketType>
+	void Send(VirtualClient& client, const PacketType& packet, int64_t nowUs)
+	{
+		size_t size = Packets.Encode(packet, SendBuffer.data(), SendBuffer.size());
+		int64_t delayUs = 0;
+		if (size == 0 || !Inject(delayUs))
+		{
+			return;
+		}
+
+		if (delayUs > 0)
+		{
+			Queue.push(Delayed{ nowUs + delayUs, &client, false, std::string((const char*)SendBuffer.data(), size) });
+			return;
+		}
+		Transmit(client, (const char*)SendBuffer.data(), size);
+	}
+
+	void Transmit(VirtualClient& client, const char* data, size_t size)
+	{
+		if (::send(client.Fd, data, (int)size, 0) == (int)size)
+		{
+			DatagramsSent.fetch_add(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			SendErrors.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void HandleRead(VirtualClient& client)
+	{
+		for (;;)
+		{
+			int n = ::recv(client.Fd, (char*)RecvBuffer.data(), (int)RecvBuffer.size(), 0);
+			if (n < 0)
+			{
+				return;
+			}
+			DatagramsReceived.fetch_add(1, std::memory_order_relaxed);
+
+			const int64_t nowUs = NowUs();
+			int64_t delayUs = 0;
+			if (!Inject(delayUs))
+			{
+				continue;
+			}
+
+			if (delayUs > 0)
+			{
+				Queue.push(Delayed{ nowUs + delayUs, &client, true, std::string((const char*)RecvBuffer.data(), n) });
+				continue;
+			}
+			Receive(client, RecvBuffer.data(), n, nowUs);
+		}
+	}
+
+	void Receive(VirtualClient& client, const uint8_t* data, size_t size, int64_t nowUs)
+	{
+		LoadPacketHandler handler = { *this, client, nowUs };
+		Packets.Dispatch(handler, data, size);
+	}
+
+	void Tick()
+	{
+		const int64_t nowUs = NowUs();
+
+		while (!Queue.empty() && Queue.top().DueUs <= nowUs)
+		{
+			const Delayed& d = Queue.top();
+			if (d.Inbound)
+			{
+				Receive(*d.Client, (const uint8_t*)d.Data.data(), d.Data.size(), nowUs);
+			}
+			else
+			{
+				Transmit(*d.Client, d.Data.data(), d.Data.size());
+			}
+			Queue.pop();
+		}
+
+		bool done = true;
+		for (auto& client : Clients)
+		{
+			Update(*client, nowUs);
+			done = done && client->Status == VirtualClient::State::Done;
+		}
+
+		if (done && !Done.load())
+		{
+			TickTimer->Cancel();
+			for (auto& client : Clients)
+			{
+				client->Channel->DisableAllEvent();
+				client->Channel->Close();
+				client->Channel.reset();
+			}
+			Done.store(true);
+		}
+	}
+
+	void Update(VirtualClient& client, int64_t nowUs)
+	{
+		typedef VirtualClient::State State;
+
+		switch (client.Status)
+		{
+		case State::Waiting:
+		{
+			if (nowUs >= client.StartUs)
+			{
+				client.Status = State::Connecting;
+				client.ConnectSentUs = nowUs;
+				Send(client, ConnectionRequestPacket(), nowUs);
+			}
+			break;
+		}
+		case State::Connecting:
+		{
+			// OnPacket(ConnectionResponsePacket) moves the client on
+			if (nowUs - client.ConnectSentUs > CONNECT_TIMEOUT_US)
+			{
+				client.TimedOut = true;
+				client.Status = State::Done;
+			}
+			else if ((nowUs - client.ConnectSentUs) / CONNECT_RETRY_US != (client.LastTickUs - client.ConnectSentUs) / CONNECT_RETRY_US)
+			{
+				Send(client, ConnectionRequestPacket(), nowUs);
+			}
+			break;
+		}
+		case State::Connected:
+		{
+			if (nowUs - client.ConnectedUs >= (int64_t)(Opts.Duration * 1000000.0))
+			{
+				client.Status = State::Draining;
+				break;
+			}
+
+			client.SendCredit += Opts.Rate * (nowUs - client.LastTickUs) / 1000000.0;
+			while (client.SendCredit >= 1.0)
+			{
+				client.SendCredit -= 1.0;
+				SendData(client, Chance(Rng) < Opts.ReliableShare, nowUs);
+			}
+			Resend(client, nowUs);
+
+			if (nowUs - client.LastStateUs >= STATE_INTERVAL_US)
+			{
+				Move(client, nowUs);
+			}
+			break;
+		}
+		case State::Draining:
+		{
+			Resend(client, nowUs);
+			if (nowUs - client.ConnectedUs >= (int64_t)(Opts.Duration * 1000000.0) + DRAIN_US)
+			{
+				client.Stats.ReliableFailed += client.ReliablePending.size();
+				client.ReliablePending.clear();
+				client.Status = State::Disconnecting;
+			}
+			break;
+		}
+		case State::Disconnecting:
+		{
+			Send(client, DisconnectPacket(), nowUs);
+			if (++client.DisconnectsSent == DISCONNECT_REPEAT)
+			{
+				client.Status = State::Done;
+			}
+			break;
+		}
+		case State::Done:
+		{
+			break;
+		}
+		}
+
+		client.LastTickUs = nowUs;
+	}
+
+	void SendData(VirtualClient& client, bool reliable, int64_t nowUs)
+	{
+		const uint32_t sequence = client.NextSequence++;
+		if (reliable)
+		{
+			client.Stats.ReliableSent++;
+			client.ReliablePending[sequence] = VirtualClient::Pending{ nowUs, nowUs, 1 };
+			SendData(client, ReliableData, sequence, nowUs);
+		}
+		else
+		{
+			client.Stats.UnreliableSent++;
+			client.Unacked[sequence % client.Unacked.size()] = sequence + 1;
+			SendData(client, UnreliableData, sequence, nowUs);
+		}
+	}
+
+	template<typename PacketType>
+	void SendData(VirtualClient& client, PacketType& packet, uint32_t sequence, int64_t nowUs)
+	{
+		packet.Sequence = sequence;
+		packet.Timestamp = (uint64_t)nowUs;
+		packet.Payload.Count = (uint16_t)std::min(Opts.Size, packet.Payload.Items.size());
+		Send(client, packet, nowUs);
+	}
+
+	// Walks the avatar with a slowly turning heading, bouncing off the edges of the world
+	void Move(VirtualClient& client, int64_t nowUs)
+	{
+		const float seconds = client.LastStateUs ? (nowUs - client.LastStateUs) / 1000000.0f : 0.0f;
+		client.LastStateUs = nowUs;
+
+		client.Heading += (float)((Chance(Rng) - 0.5) * 0.5);
+		client.X += std::cos(client.Heading) * AVATAR_SPEED * seconds;
+		client.Y += std::sin(client.Heading) * AVATAR_SPEED * seconds;
+		if (client.X < 0.0f || client.X > WORLD_SIZE || client.Y < 0.0f || client.Y > WORLD_SIZE)
+		{
+			client.X = std::min(std::max(client.X, 0.0f), WORLD_SIZE);
+			client.Y = std::min(std::max(client.Y, 0.0f), WORLD_SIZE);
+			client.Heading += PI;
+		}
+
+		ClientStatePacket state;
+		state.X = client.X;
+		state.Y = client.Y;
+		Send(client, state, nowUs);
+	}
+
+	void Resend(VirtualClient& client, int64_t nowUs)
+	{
+		for (auto it = client.ReliablePending.begin(); it != client.ReliablePending.end();)
+		{
+			VirtualClient::Pending& pending = it->second;
+			if (nowUs - pending.SentUs < RELIABLE_RESEND_US)
+			{
+				++it;
+				continue;
+			}
+
+			if (pending.Attempts == RELIABLE_MAX_ATTEMPTS)
+			{
+				client.Stats.ReliableFailed++;
+				it = client.ReliablePending.erase(it);
+				continue;
+			}
+
+			pending.SentUs = nowUs;
+			pending.Attempts++;
+			client.Stats.Retransmits++;
+			SendData(client, ReliableData, it->first, nowUs);
+			++it;
+		}
+	}
+
+private:
+	const Options& Opts;
+	sockaddr_storage Server;
+	std::mt19937 Rng;
+	std::uniform_real_distribution<double> Chance{ 0.0, 1.0 };
+
+	evpp::EventLoopThread Thread;
+	evpp::InvokeTimerPtr TickTimer;
+	std::atomic<bool> Done{ false };
+
+	std::vector<std::unique_ptr<VirtualClient>> Clients;
+	std::priority_queue<Delayed, std::vector<Delayed>, std::greater<Delayed>> Queue;
+
+	GamePacketRegistry Packets;
+	Histogram ConnectLatency;
+
+	// Reused for every DataPacket, only the header changes
+	DataPacket UnreliableData;
+	ReliableDataPacket ReliableData;
+	std::array<uint8_t, MAX_PACKET_SIZE> SendBuffer;
+	std::array<uint8_t, MAX_PACKET_SIZE> RecvBuffer;
+};
+
+void LoadPacketHandler::OnPacket(const ConnectionResponsePacket& response)
+{
+	if (Client.Status != VirtualClient::State::Connecting)
+	{
+		return;
+	}
+
+	if (response.Status == (uint8_t)ConnectionStatus::Accepted)
+	{
+		Client.Accepted = true;
+		Client.Status = VirtualClient::State::Connected;
+		Client.ConnectedUs = NowUs;
+		Owner.ConnectLatency.Record(NowUs - Client.ConnectSentUs);
+	}
+	else
+	{
+		Client.Denied = true;
+		Client.Status = VirtualClient::State::Done;
+	}
+}
+
+void LoadPacketHandler::OnPacket(const DataAckPacket& ack)
+{
+	if (ack.Reliable)
+	{
+		auto it = Client.ReliablePending.find(ack.Sequence);
+		if (it == Client.ReliablePending.end())
+		{
+			// Acknowledgement of a retransmission
+			return;
+		}
+		const VirtualClient::Pending pending = it->second;
+		Client.ReliablePending.erase(it);
+		Client.Stats.ReliableAcked++;
+		Client.Stats.ReliableDelivery.Record((uint64_t)std::max<int64_t>(0, NowUs - pending.FirstSentUs));
+
+		// Karn's rule: the acknowledgement of a retransmitted packet may belong to any of its copies, it is no RTT sample
+		if (pending.Attempts > 1)
+		{
+			return;
+		}
+	}
+	else
+	{
+		uint32_t& unacked = Client.Unacked[ack.Sequence % Client.Unacked.size()];
+		if (unacked != ack.Sequence + 1)
+		{
+			return;
+		}
+		unacked = 0;
+		Client.Stats.UnreliableAcked++;
+	}
+
+	Client.Stats.Rtt.Record((uint64_t)std::max<int64_t>(0, NowUs - (int64_t)ack.Timestamp));
+}
+
+void LoadPacketHandler::OnPacket(const EntityReplicationPacket& replication)
+{
+	Client.Stats.ReplicationPackets++;
+	Client.Stats.ReplicatedEntered += replication.Entered.Size();
+	Client.Stats.ReplicatedUpdates += replication.Updates.Size();
+}
+
+bool ParseOption(const char* arg, const char* name, std::string& value)
+{
+	const size_t length = strlen(name);
+	if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, length) != 0 || arg[2 + length] != '=')
+	{
+		return false;
+	}
+	value = arg + 3 + length;
+	return true;
+}
+
+std::string Millis(uint64_t us)
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(3) << us / 1000.0 << " ms";
+	return out.str();
+}
+
+int main(int argc, char** argv)
+{
+#ifdef _WIN32
+	WSADATA wsadata;
+	if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
+	{
+		std::cout << "Error: Failed to initialize winsock API." << std::endl;
+		return 1;
+	}
+#endif
+
+	Options options;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string value;
+		if (ParseOption(argv[i], "server", value)) { options.Server = value; }
+		else if (ParseOption(argv[i], "clients", value)) { options.Clients = std::max(1, std::atoi(value.c_str())); }
+		else if (ParseOption(argv[i], "threads", value)) { options.Threads = std::max(1, std::atoi(value.c_str())); }
+		else if (ParseOption(argv[i], "duration", value)) { options.Duration = std::atof(value.c_str()); }
+		else if (ParseOption(argv[i], "rate", value)) { options.Rate = std::atof(value.c_str()); }
+		else if (ParseOption(argv[i], "size", value)) { options.Size = (size_t)std::atoi(value.c_str()); }
+		else if (ParseOption(argv[i], "reliable", value)) { options.ReliableShare = std::atof(value.c_str()); }
+		else if (ParseOption(argv[i], "ramp", value)) { options.Ramp = std::atof(value.c_str()); }
+		else if (ParseOption(argv[i], "latency", value)) { options.LatencyMs = std::atof(value.c_str()); }
+		else if (ParseOption(argv[i], "jitter", value)) { options.JitterMs = std::atof(value.c_str()); }
+		else if (ParseOption(argv[i], "loss", value)) { options.LossPercent = std::atof(value.c_str()); }
+		else
+		{
+			std::cout << "Error: Unknown option " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+
+	sockaddr_storage server = evpp::sock::ParseFromIPPort(options.Server.c_str());
+	if (evpp::sock::IsZeroAddress(&server))
+	{
+		std::cout << "Error: Cannot parse the server address " << options.Server << std::endl;
+		return 1;
+	}
+
+	options.Threads = std::min(options.Threads, options.Clients);
+	std::vector<std::unique_ptr<Worker>> workers;
+	for (int i = 0; i < options.Threads; ++i)
+	{
+		workers.emplace_back(new Worker(options, server, 42 + i));
+	}
+
+	const int64_t startUs = NowUs();
+	for (int i = 0; i < options.Clients; ++i)
+	{
+		workers[i % options.Threads]->AddClient(startUs + (int64_t)(options.Ramp * 1000000.0 * i / options.Clients));
+	}
+
+	for (auto& worker : workers)
+	{
+		if (!worker->Start())
+		{
+			return 1;
+		}
+	}
+
+	std::cout << options.Clients << " clients on " << options.Threads << " threads to " << options.Server << std::endl;
+
+	// Progress once per second
+	uint64_t lastSent = 0, lastReceived = 0;
+	for (;;)
+	{
+		bool done = false;
+		for (int waited = 0; waited < 100 && !done; ++waited)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			done = std::all_of(workers.begin(), workers.end(), [](const std::unique_ptr<Worker>& worker) { return worker->IsDone(); });
+		}
+
+		uint64_t sent = 0, received = 0;
+		for (auto& worker : workers)
+		{
+			sent += worker->DatagramsSent.load();
+			received += worker->DatagramsReceived.load();
+		}
+		std::cout << "out " << sent - lastSent << " pps, in " << received - lastReceived << " pps" << std::endl;
+		lastSent = sent;
+		lastReceived = received;
+
+		if (done)
+		{
+			break;
+		}
+	}
+
+	const double elapsed = (NowUs() - startUs) / 1000000.0;
+	for (auto& worker : workers)
+	{
+		worker->Stop();
+	}
+
+	// Aggregate, the worker threads are stopped
+	uint64_t accepted = 0, denied = 0, timedOut = 0;
+	uint64_t sent = 0, received = 0, injected = 0, sendErrors = 0, malformed = 0;
+	ClientStats total;
+	Histogram connectLatency;
+	uint64_t worstClientP99 = 0;
+	for (auto& worker : workers)
+	{
+		sent += worker->DatagramsSent.load();
+		received += worker->DatagramsReceived.load();
+		injected += worker->InjectedDrops.load();
+		sendErrors += worker->SendErrors.load();
+		connectLatency.Merge(worker->GetConnectLatency());
+		for (size_t id = 0; id < GamePacketRegistry::MaxPackets; ++id)
+		{
+			malformed += worker->GetPackets().GetCounters((uint8_t)id).Malformed;
+		}
+
+		for (auto& client : worker->GetClients())
+		{
+			accepted += client->Accepted;
+			denied += client->Denied;
+			timedOut += client->TimedOut;
+
+			const ClientStats& stats = client->Stats;
+			total.UnreliableSent += stats.UnreliableSent;
+			total.UnreliableAcked += stats.UnreliableAcked;
+			total.ReliableSent += stats.ReliableSent;
+			total.ReliableAcked += stats.ReliableAcked;
+			total.ReliableFailed += stats.ReliableFailed;
+			total.Retransmits += stats.Retransmits;
+			total.ReplicationPackets += stats.ReplicationPackets;
+			total.ReplicatedEntered += stats.ReplicatedEntered;
+			total.ReplicatedUpdates += stats.ReplicatedUpdates;
+			total.Rtt.Merge(stats.Rtt);
+			total.ReliableDelivery.Merge(stats.ReliableDelivery);
+			worstClientP99 = std::max(worstClientP99, stats.Rtt.Percentile(0.99));
+		}
+	}
+
+	const double unreliableLoss = total.UnreliableSent ? 100.0 * (total.UnreliableSent - total.UnreliableAcked) / total.UnreliableSent : 0.0;
+
+	std::cout << std::endl;
+	std::cout << "clients:         " << options.Clients << " (" << accepted << " accepted, " << denied << " denied, " << timedOut << " timed out)" << std::endl;
+	std::cout << "connect latency: p50 " << Millis(connectLatency.Percentile(0.50)) << ", p99 " << Millis(connectLatency.Percentile(0.99))
+		<< ", max " << Millis(connectLatency.GetMax()) << std::endl;
+	std::cout << "datagrams:       " << sent << " out, " << received << " in, " << injected << " dropped by injection, " << sendErrors << " send errors, " << malformed << " malformed" << std::endl;
+	std::cout << "rate:            " << (uint64_t)(sent / elapsed) << " pps out, " << (uint64_t)(received / elapsed) << " pps in over " << elapsed << " s" << std::endl;
+	std::cout << "unreliable:      " << total.UnreliableSent << " sent, " << total.UnreliableAcked << " acked, " << unreliableLoss << "% round trip loss" << std::endl;
+	std::cout << "reliable:        " << total.ReliableSent << " sent, " << total.ReliableAcked << " acked, " << total.Retransmits << " retransmits, " << total.ReliableFailed << " failed" << std::endl;
+	std::cout << "rtt:             p50 " << Millis(total.Rtt.Percentile(0.50)) << ", p99 " << Millis(total.Rtt.Percentile(0.99))
+		<< ", p999 " << Millis(total.Rtt.Percentile(0.999)) << ", max " << Millis(total.Rtt.GetMax()) << std::endl;
+	std::cout << "delivery:        p50 " << Millis(total.ReliableDelivery.Percentile(0.50)) << ", p99 " << Millis(total.ReliableDelivery.Percentile(0.99))
+		<< ", max " << Millis(total.ReliableDelivery.GetMax()) << " from the first send of a reliable packet to its acknowledgement" << std::endl;
+	std::cout << "worst client p99: " << Millis(worstClientP99) << std::endl;
+	std::cout << "replication:     " << total.ReplicationPackets << " packets, " << total.ReplicatedEntered << " entities entered, "
+		<< (total.ReplicationPackets ? (double)total.ReplicatedUpdates / total.ReplicationPackets : 0.0) << " updates per packet" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,373 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+/*
+Compile time typed packet registry.
+
+A packet type declares everything about itself once:
+
+	struct ConnectionResponse
+	{
+		static const uint8_t Id = 3;
+		static const Reliability Class = Reliability::Reliable;
+
+		uint8_t Status;
+		uint16_t ClientIdentifier;
+
+		template<typename Self, typename Visitor>
+		static bool Fields(Self& self, Visitor& visitor) { return visitor(self.Status) && visitor(self.ClientIdentifier); }
+	};
+
+The field list drives both encoding and decoding. On the wire a packet is its id byte followed by
+its fields in declaration order, integers in network byte order, BoundedArray as a uint16_t count
+followed by the items. Nested structs with a Fields function are encoded inline.
+*/
+
+enum class Reliability : uint8_t
+{
+	Unreliable,
+	Reliable,
+};
+
+// Array field with inline storage, so decoding never allocates.
+template<typename T, size_t Capacity>
+struct BoundedArray
+{
+	std::array<T, Capacity> Items;
+	uint16_t Count = 0;
+
+	static_assert(Capacity <= UINT16_MAX, "BoundedArray count is encoded as uint16_t");
+
+	bool Push(const T& item)
+	{
+		if (Count == Capacity)
+		{
+			return false;
+		}
+		Items[Count++] = item;
+		return true;
+	}
+
+	void Clear() { Count = 0; }
+	size_t Size() const { return Count; }
+	bool Empty() const { return Count == 0; }
+	bool Full() const { return Count == Capacity; }
+	const T& operator[](size_t i) const { return Items[i]; }
+	const T* begin() const { return Items.data(); }
+	const T* end() const { return Items.data() + Count; }
+};
+
+namespace PacketCodec
+{
+	// Field visitor writing into a caller provided buffer, fails instead of overflowing it.
+	class Writer
+	{
+	public:
+		Writer(uint8_t* data, size_t capacity) : Data(data), Capacity(capacity), Offset(0) {}
+
+		template<typename T>
+		bool operator()(const T& value) { return Write(value); }
+
+		size_t GetSize() const { return Offset; }
+
+	private:
+		template<typename T>
+		typename std::enable_if<std::is_integral<T>::value, bool>::type Write(T value)
+		{
+			if (Capacity - Offset < sizeof(T))
+			{
+				return false;
+			}
+			for (size_t i = 0; i < sizeof(T); ++i)
+			{
+				Data[Offset + i] = static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * (sizeof(T) - 1 - i)));
+			}
+			Offset += sizeof(T);
+			return true;
+		}
+
+		bool Write(float value)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			return Write(bits);
+		}
+
+		template<typename T, size_t N>
+		bool Write(const BoundedArray<T, N>& array)
+		{
+			if (!Write(array.Count))
+			{
+				return false;
+			}
+			for (const T& item : array)
+			{
+				if (!Write(item))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		template<typename T>
+		typename std::enable_if<std::is_class<T>::value, bool>::type Write(const T& value)
+		{
+			return T::Fields(value, *this);
+		}
+
+	private:
+		uint8_t* Data;
+		size_t Capacity;
+		size_t Offset;
+	};
+
+	// Field visitor reading from a received datagram, fails instead of reading past its end.
+	class Reader
+	{
+	public:
+		Reader(const uint8_t* data, size_t size) : Data(data), Size(size), Offset(0) {}
+
+		template<typename T>
+		bool operator()(T& value) { return Read(value); }
+
+		bool AtEnd() const { return Offset == Size; }
+
+	private:
+		template<typename T>
+		typename std::enable_if<std::is_integral<T>::value, bool>::type Read(T& value)
+		{
+			if (Size - Offset < sizeof(T))
+			{
+				return false;
+			}
+			uint64_t v = 0;
+			for (size_t i = 0; i < sizeof(T); ++i)
+			{
+				v = (v << 8) | Data[Offset + i];
+			}
+			value = static_cast<T>(v);
+			Offset += sizeof(T);
+			return true;
+		}
+
+		bool Read(float& value)
+		{
+			uint32_t bits;
+			if (!Read(bits))
+			{
+				return false;
+			}
+			memcpy(&value, &bits, sizeof(value));
+			return true;
+		}
+
+		template<typename T, size_t N>
+		bool Read(BoundedArray<T, N>& array)
+		{
+			uint16_t count;
+			if (!Read(count) || count > N)
+			{
+				return false;
+			}
+			for (uint16_t i = 0; i < count; ++i)
+			{
+				if (!Read(array.Items[i]))
+				{
+					return false;
+				}
+			}
+			array.Count = count;
+			return true;
+		}
+
+		template<typename T>
+		typename std::enable_if<std::is_class<T>::value, bool>::type Read(T& value)
+		{
+			return T::Fields(value, *this);
+		}
+
+	private:
+		const uint8_t* Data;
+		size_t Size;
+		size_t Offset;
+	};
+}
+
+enum class DispatchResult
+{
+	Ok,
+	Unknown,
+	Malformed,
+};
+
+struct PacketCounters
+{
+	uint64_t Sent = 0;
+	uint64_t SentBytes = 0;
+	uint64_t Received = 0;
+	uint64_t ReceivedBytes = 0;
+	uint64_t Malformed = 0;
+};
+
+// Dispatch() looks the id byte up in a jump table generated at compile time and makes one indirect
+// call, which decodes the packet on the stack and calls handler.OnPacket(const PacketType&) directly.
+template<typename... Packets>
+class PacketRegistry
+{
+public:
+	static const size_t MaxPackets = 256;
+
+	template<typename Packet>
+	size_t Encode(const Packet& packet, uint8_t* buffer, size_t capacity)
+	{
+		static_assert(Contains<Packet>(), "Packet type is not registered");
+
+		PacketCodec::Writer writer(buffer, capacity);
+		if (!writer(static_cast<uint8_t>(Packet::Id)) || !Packet::Fields(packet, writer))
+		{
+			return 0;
+		}
+
+		PacketCounters& counters = Counters[Packet::Id];
+		counters.Sent++;
+		counters.SentBytes += writer.GetSize();
+		return writer.GetSize();
+	}
+
+	// The data includes the id byte. Trailing bytes make the packet malformed.
+	template<typename Packet>
+	static bool Decode(Packet& packet, const uint8_t* data, size_t size)
+	{
+		PacketCodec::Reader reader(data, size);
+		uint8_t id;
+		return reader(id) && id == Packet::Id && Packet::Fields(packet, reader) && reader.AtEnd();
+	}
+
+	template<typename Handler>
+	DispatchResult Dispatch(Handler& handler, const uint8_t* data, size_t size)
+	{
+		if (size == 0)
+		{
+			UnknownCount++;
+			return DispatchResult::Unknown;
+		}
+		return DispatchById<Handler>(data[0], handler, data, size, std::make_index_sequence<MaxPackets>());
+	}
+
+	template<typename Packet>
+	const PacketCounters& GetCounters() const { return Counters[Packet::Id]; }
+	const PacketCounters& GetCounters(uint8_t id) const { return Counters[id]; }
+	uint64_t GetUnknownCount() const { return UnknownCount; }
+
+	static Reliability GetReliability(uint8_t id)
+	{
+		return ReliabilityById(id, std::make_index_sequence<MaxPackets>());
+	}
+
+private:
+	template<typename Handler>
+	using Thunk = DispatchResult(*)(PacketRegistry&, Handler&, const uint8_t*, size_t);
+
+	template<size_t Id, typename... Ps>
+	struct FindById
+	{
+		using Type = void;
+	};
+
+	template<size_t Id, typename P, typename... Ps>
+	struct FindById<Id, P, Ps...>
+	{
+		using Type = typename std::conditional<P::Id == Id, P, typename FindById<Id, Ps...>::Type>::type;
+	};
+
+	template<typename Handler, typename Packet>
+	struct ThunkFor
+	{
+		static constexpr Thunk<Handler> Get() { return &Invoke<Handler, Packet>; }
+	};
+
+	template<typename Handler>
+	struct ThunkFor<Handler, void>
+	{
+		static constexpr Thunk<Handler> Get() { return &InvokeUnknown<Handler>; }
+	};
+
+	template<typename Handler, size_t... Ids>
+	DispatchResult DispatchById(uint8_t id, Handler& handler, const uint8_t* data, size_t size, std::index_sequence<Ids...>)
+	{
+		static constexpr Thunk<Handler> Table[] = { ThunkFor<Handler, typename FindById<Ids, Packets...>::Type>::Get()... };
+		return Table[id](*this, handler, data, size);
+	}
+
+	template<size_t... Ids>
+	static Reliability ReliabilityById(uint8_t id, std::index_sequence<Ids...>)
+	{
+		static constexpr Reliability Table[] = { ClassOf(static_cast<typename FindById<Ids, Packets...>::Type*>(nullptr))... };
+		return Table[id];
+	}
+
+	template<typename Packet>
+	static constexpr Reliability ClassOf(Packet*) { return Packet::Class; }
+	static constexpr Reliability ClassOf(void*) { return Reliability::Unreliable; }
+
+	template<typename Handler, typename Packet>
+	static DispatchResult Invoke(PacketRegistry& registry, Handler& handler, const uint8_t* data, size_t size)
+	{
+		PacketCounters& counters = registry.Counters[Packet::Id];
+
+		Packet packet;
+		if (!Decode(packet, data, size))
+		{
+			counters.Malformed++;
+			return DispatchResult::Malformed;
+		}
+
+		counters.Received++;
+		counters.ReceivedBytes += size;
+		handler.OnPacket(static_cast<const Packet&>(packet));
+		return DispatchResult::Ok;
+	}
+
+	template<typename Handler>
+	static DispatchResult InvokeUnknown(PacketRegistry& registry, Handler&, const uint8_t*, size_t)
+	{
+		registry.UnknownCount++;
+		return DispatchResult::Unknown;
+	}
+
+	template<typename Packet>
+	static constexpr bool Contains()
+	{
+		return std::is_same<typename FindById<Packet::Id, Packets...>::Type, Packet>::value;
+	}
+
+	static constexpr bool UniqueIds()
+	{
+		const size_t ids[] = { Packets::Id... };
+		for (size_t i = 0; i < sizeof...(Packets); ++i)
+		{
+			for (size_t j = i + 1; j < sizeof...(Packets); ++j)
+			{
+				if (ids[i] == ids[j])
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	static_assert(sizeof...(Packets) > 0, "PacketRegistry needs at least one packet type");
+	static_assert(UniqueIds(), "Two packet types share the same id");
+
+private:
+	std::array<PacketCounters, MaxPackets> Counters;
+	uint64_t UnknownCount = 0;
+};
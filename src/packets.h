@@ -0,0 +1,139 @@
+#pragma once
+
+#include "packet_registry.h"
+#include "fragmentation.h"
+
+// The packets exchanged by HelloEvppServer and HelloEvppClient. Both sides include this file,
+// so a packet layout is defined in exactly one place.
+
+const size_t MAX_PACKET_SIZE = 1472; // The UDP max payload size
+const size_t MAX_MESSAGE_SIZE = 64 * 1024; // Packets larger than MAX_PACKET_SIZE are sent as fragments, see fragmentation.h
+
+enum class ConnectionStatus : uint8_t
+{
+	Denied = 0,
+	Accepted = 1,
+};
+
+struct EntityState
+{
+	uint32_t Entity;
+	float X;
+	float Y;
+
+	template<typename Self, typename Visitor>
+	static bool Fields(Self& self, Visitor& visitor) { return visitor(self.Entity) && visitor(self.X) && visitor(self.Y); }
+};
+
+// Server -> client, every replication tick. See replication_cb in server.cpp.
+struct EntityReplicationPacket
+{
+	static const uint8_t Id = 0;
+	static const Reliability Class = Reliability::Unreliable;
+
+	BoundedArray<uint32_t, 64> Entered;
+	BoundedArray<uint32_t, 64> Left;
+	BoundedArray<EntityState, 64> Updates;
+
+	template<typename Self, typename Visitor>
+	static bool Fields(Self& self, Visitor& visitor) { return visitor(self.Entered) && visitor(self.Left) && visitor(self.Updates); }
+};
+
+// Client -> server
+struct ConnectionRequestPacket
+{
+	static const uint8_t Id = 2;
+	static const Reliability Class = Reliability::Reliable;
+
+	template<typename Self, typename Visitor>
+	static bool Fields(Self&, Visitor&) { return true; }
+};
+
+// Server -> client
+struct ConnectionResponsePacket
+{
+	static const uint8_t Id = 3;
+	static const Reliability Class = Reliability::Reliable;
+
+	uint8_t Status; // ConnectionStatus
+	uint16_t ClientIdentifier;
+
+	template<typename Self, typename Visitor>
+	static bool Fields(Self& self, Visitor& visitor) { return visitor(self.Status) && visitor(self.ClientIdentifier); }
+};
+
+struct DataFields
+{
+	uint32_t Sequence;
+	uint64_t Timestamp; // Set by the sender, echoed back in the DataAckPacket
+	BoundedArray<uint8_t, 1024> Payload;
+
+	template<typename Self, typename Visitor>
+	static bool Fields(Self& self, Visitor& visitor) { return visitor(self.Sequence) && visitor(self.Timestamp) && visitor(self.Payload); }
+};
+
+// Client -> server, acknowledged with a DataAckPacket. Lost packets are not sent again.
+struct DataPacket : DataFields
+{
+	static const uint8_t Id = 4;
+	static const Reliability Class = Reliability::Unreliable;
+};
+
+// Client -> server, acknowledged with a DataAckPacket. The sender retransmits it until it is acknowledged.
+struct ReliableDataPacket : DataFields
+{
+	static const uint8_t Id = 5;
+	static const Reliability Class = Reliability::Reliable;
+};
+
+// Server -> client
+struct DataAckPacket
+{
+	static const uint8_t Id = 6;
+	static const Reliability Class = Reliability::Unreliable;
+
+	uint32_t Sequence;
+	uint64_t Timestamp;
+	uint8_t Reliable;
+
+	template<typename Self, typename Visitor>
+	static bool Fields(Self& self, Visitor& visitor) { return visitor(self.Sequence) && visitor(self.Timestamp) && visitor(self.Reliable); }
+};
+
+// Client -> server, frees the client's slot. There is no reply, so clients send it a few times.
+struct DisconnectPacket
+{
+	static const uint8_t Id = 7;
+	static const Reliability Class = Reliability::Reliable;
+
+	template<typename Self, typename Visitor>
+	static bool Fields(Self&, Visitor&) { return true; }
+};
+
+// Client -> server, the position of the client's avatar. The avatar is the entity with the client
+// identifier as id, and the client's area of interest is centered on it. Only the latest one matters.
+struct ClientStatePacket
+{
+	static const uint8_t Id = 8;
+	static const Reliability Class = Reliability::Unreliable;
+
+	float X;
+	float Y;
+
+	template<typename Self, typename Visitor>
+	static bool Fields(Self& self, Visitor& visitor) { return visitor(self.X) && visitor(self.Y); }
+};
+
+// Id 0xFF is taken by FragmentPacketId
+typedef PacketRegistry<
+	EntityReplicationPacket,
+	ConnectionRequestPacket,
+	ConnectionResponsePacket,
+	DataPacket,
+	ReliableDataPacket,
+	DataAckPacket,
+	DisconnectPacket,
+	ClientStatePacket> GamePacketRegistry;
+
+static_assert(sizeof(uint8_t) + 3 * sizeof(uint16_t) + (64 + 64) * sizeof(uint32_t) + 64 * 12 <= MAX_PACKET_SIZE,
+	"A full EntityReplicationPacket must fit in one datagram");
@@ -1,10 +1,19 @@
 #include <evpp/udp/udp_server.h>
 #include <evpp/udp/udp_message.h>
+#include <evpp/udp/udp_capture.h>
+#include <evpp/timestamp.h>
+#include <evpp/async_logging.h>
+
+#include "interest.h"
+#include "packets.h"
 
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <cmath>
 
 const uint32_t MAX_CLIENTS = 128;
+const uint32_t MAX_ENTITIES = 16384;
 
 static const uint16_t InvalidIdentifier = UINT16_MAX;
 
@@ -326,6 +335,14 @@ static void test_address()
 // http://www.blog.matejzavrsnik.com/map_vs_unordered_map_performance.html
 std::array<Address, MAX_CLIENTS> ClientAddress;
 std::array<bool, MAX_CLIENTS> ClientConnected;
+std::array<sockaddr_in, MAX_CLIENTS> ClientSockAddr;
+
+// Which entities each client can see, see replication_cb. Every client has an avatar,
+// the entity with the client identifier as id, moved by its ClientStatePackets.
+InterestManager Interest(128.0f, 256.0f, MAX_ENTITIES, MAX_CLIENTS);
+
+// Avatar positions are limited to this distance from the origin on each axis
+const float WORLD_HALF_EXTENT = 65536.0f;
 
 uint16_t FindFreeClientIdentifier()
 {
@@ -382,13 +399,38 @@ bool IsClientConnected(uint16_t clientIdentifier)
 #include <event2/event.h>
 
 void cb_func(evutil_socket_t fd, short what, void* arg);
+void replication_cb(evutil_socket_t fd, short what, void* arg);
+int replay(const char* path, double speed);
 
 struct sockaddr_in servaddr;
 
 int cnt = 0;
 
+// Every received datagram is appended to it when the server runs with --capture
+evpp::udp::Capture PacketCapture;
+
 int main(int argc, char** argv)
 {
+	// Usage:
+	//  HelloEvppServer --capture <file> [megabytes=256]   Record the received datagrams
+	//  HelloEvppServer --replay <file> [speed=0]          Feed a capture to the packet handlers without a socket.
+	//                                                     speed 1 keeps the original timing, 0 is as fast as possible
+	if (argc > 2 && strcmp(argv[1], "--replay") == 0)
+	{
+		return replay(argv[2], argc > 3 ? atof(argv[3]) : 0.0);
+	}
+
+	if (argc > 2 && strcmp(argv[1], "--capture") == 0)
+	{
+		uint64_t megabytes = argc > 3 ? strtoull(argv[3], nullptr, 10) : 256;
+		if (!PacketCapture.Open(argv[2], megabytes * 1024 * 1024))
+		{
+			std::cout << "Error: Failed to open the capture file " << argv[2] << std::endl;
+			return 1;
+		}
+		std::cout << "capturing to " << argv[2] << std::endl;
+	}
+
 	// WSAStartup
 	WSADATA wsadata;
 
@@ -447,15 +489,18 @@ int main(int argc, char** argv)
 
 	std::cout << "bound" << std::endl;
 
-	event* ev1, * ev2;
+	event* ev1, * ev2, * ev3;
 	timeval five_seconds = { 5, 0 };
+	timeval replication_interval = { 0, 50 * 1000 }; // 20 ticks per second
 	// event_base* base = event_base_new();
 
 	ev1 = event_new(base, sockfd, EV_TIMEOUT | EV_READ | EV_PERSIST, cb_func, (char*)"Reading event");
 	ev2 = event_new(base, sockfd, EV_WRITE | EV_PERSIST, cb_func, (char*)"Writing event");
+	ev3 = event_new(base, -1, EV_PERSIST, replication_cb, nullptr);
 
 	event_add(ev1, &five_seconds);
 	event_add(ev2, nullptr);
+	event_add(ev3, &replication_interval);
 	event_base_dispatch(base);
 
 	return 0;
@@ -463,44 +508,257 @@ int main(int argc, char** argv)
 
 struct Packet
 {
-	void* data;
-	uint16_t size;
-	uint16_t recvaddrsize;
-	sockaddr* recvaddr;
+	void* data = nullptr;
+	uint16_t size = 0;
+	uint16_t recvaddrsize = 0;
+	sockaddr_in recvaddr;
+
+	~Packet() { free(data); }
 };
 
 std::array<std::shared_ptr<Packet>, 1024> packets;
 
 int cursor = 0;
+int sendCursor = 0;
+
+// Packets dropped because the ring was full, they would have overwritten unsent ones
+uint64_t droppedSends = 0;
 
 void send(std::shared_ptr<Packet> packet)
 {
+	const int next = (cursor + 1) % (int)packets.size();
+	if (next == sendCursor)
+	{
+		droppedSends++;
+		ALOG_EVERY_MS(evpp::kLogWarn, 1000) << "send ring full, " << droppedSends << " packets dropped so far";
+		return;
+	}
+
 	packets[cursor] = packet;
-	cursor = (cursor + 1) % 1024;
+	cursor = next;
+}
+
+GamePacketRegistry GamePackets;
+
+// Large messages from clients are only reassembled once they are connected, each one gets a couple of slots
+const uint32_t REASSEMBLY_SLOTS_PER_CLIENT = 2;
+const int64_t REASSEMBLY_TIMEOUT_MS = 1000;
+
+Fragmenter Fragments(MAX_PACKET_SIZE);
+Reassembler Reassembly(MAX_CLIENTS, REASSEMBLY_SLOTS_PER_CLIENT, MAX_MESSAGE_SIZE, MAX_PACKET_SIZE, REASSEMBLY_TIMEOUT_MS);
+
+// In --replay mode the clock follows the capture timestamps, so that reassembly timeouts behave as they did
+// while recording, whatever the replay speed
+int64_t ReplayClockMs = -1;
+
+int64_t NowMs()
+{
+	if (ReplayClockMs >= 0)
+	{
+		return ReplayClockMs;
+	}
+	return evpp::Timestamp::Now().UnixNano() / 1000000;
+}
+
+void send(const uint8_t* data, size_t size, const sockaddr_in& to)
+{
+	std::shared_ptr<Packet> res = std::make_shared<Packet>();
+	res->recvaddr = to;
+	res->recvaddrsize = sizeof(to);
+	res->size = (uint16_t)size;
+	res->data = malloc(size);
+	memcpy(res->data, data, size);
+	send(res);
+}
+
+template<typename PacketType>
+void SendPacket(const PacketType& packet, const sockaddr_in& to)
+{
+	static std::array<uint8_t, MAX_MESSAGE_SIZE> buffer;
+	size_t size = GamePackets.Encode(packet, buffer.data(), buffer.size());
+	if (size == 0)
+	{
+		ALOG_ERROR << "failed to encode packet " << (int)PacketType::Id;
+		return;
+	}
+
+	if (size <= MAX_PACKET_SIZE)
+	{
+		send(buffer.data(), size, to);
+	}
+	else if (!Fragments.Split(buffer.data(), size, [&](const uint8_t* fragment, size_t fragmentSize) { send(fragment, fragmentSize, to); }))
+	{
+		ALOG_ERROR << "packet " << (int)PacketType::Id << " of " << size << " bytes is too large";
+	}
 }
 
-#include <bitset>
+void DisconnectClient(uint16_t clientIdentifier);
+
+struct ServerPacketHandler
+{
+	const sockaddr_in& From;
+	const Address& FromAddress;
+
+	void OnPacket(const ConnectionRequestPacket& request)
+	{
+		// WARN: This connection protocol, although fast, very unsecure. This will have to be changed before production.
+		// Read: https://gafferongames.com/post/client_server_connection/
+
+		ConnectionResponsePacket response;
+
+		/*
+		If the sender corresponds to the address of a client that is already connected, also reply with connection accepted.
+		This is necessary because the first response packet may not have gotten through due to packet loss. If we don't resend this response,
+		the client gets stuck in the connecting state until it times out.
+		*/
+		uint16_t clientIdentifier = FindClientIdentifier(FromAddress);
+		if (clientIdentifier != InvalidIdentifier)
+		{
+			ALOG_DEBUG << "client already connected";
+
+			response.Status = (uint8_t)ConnectionStatus::Accepted;
+			response.ClientIdentifier = clientIdentifier;
+			SendPacket(response, From);
+			return;
+		}
+
+		// TODO challenge
+
+		/*
+		If the connection request is from a new client and we have a slot free,
+		assign the client to a free slot and respond with connection accepted.
+		*/
+		uint16_t freeIdentifier = FindFreeClientIdentifier();
+		if (freeIdentifier != InvalidIdentifier)
+		{
+			ALOG_INFO << "client " << freeIdentifier << " connected from " << FromAddress.ToString();
+
+			ClientAddress[freeIdentifier] = FromAddress;
+			ClientConnected[freeIdentifier] = true;
+			ClientSockAddr[freeIdentifier] = From;
+			Interest.SetClient(freeIdentifier, 0.0f, 0.0f);
+			Interest.SetEntity(freeIdentifier, 0.0f, 0.0f);
+
+			response.Status = (uint8_t)ConnectionStatus::Accepted;
+			response.ClientIdentifier = freeIdentifier;
+			SendPacket(response, From);
+		}
+
+		/*
+		If the server is full, reply with connection denied.
+		*/
+		else
+		{
+			ALOG_EVERY_MS(evpp::kLogWarn, 1000) << "server full";
+
+			response.Status = (uint8_t)ConnectionStatus::Denied;
+			response.ClientIdentifier = InvalidIdentifier;
+			SendPacket(response, From);
+		}
+	}
+
+	void OnPacket(const DataPacket& data)
+	{
+		Acknowledge(data, false);
+	}
+
+	void OnPacket(const ReliableDataPacket& data)
+	{
+		Acknowledge(data, true);
+	}
+
+	void Acknowledge(const DataFields& data, bool reliable)
+	{
+		if (FindClientIdentifier(FromAddress) == InvalidIdentifier)
+		{
+			return;
+		}
+
+		DataAckPacket ack;
+		ack.Sequence = data.Sequence;
+		ack.Timestamp = data.Timestamp;
+		ack.Reliable = reliable ? 1 : 0;
+		SendPacket(ack, From);
+	}
+
+	void OnPacket(const ClientStatePacket& state)
+	{
+		uint16_t clientIdentifier = FindClientIdentifier(FromAddress);
+		if (clientIdentifier == InvalidIdentifier)
+		{
+			return;
+		}
+
+		// Also rejects NaN, which fails every comparison
+		if (!(std::fabs(state.X) <= WORLD_HALF_EXTENT) || !(std::fabs(state.Y) <= WORLD_HALF_EXTENT))
+		{
+			ALOG_EVERY_MS(evpp::kLogWarn, 1000) << "invalid position from client " << clientIdentifier;
+			return;
+		}
+
+		Interest.SetEntity(clientIdentifier, state.X, state.Y);
+		Interest.SetClient(clientIdentifier, state.X, state.Y);
+	}
+
+	void OnPacket(const DisconnectPacket&)
+	{
+		// Clients send it more than once
+		uint16_t clientIdentifier = FindClientIdentifier(FromAddress);
+		if (clientIdentifier != InvalidIdentifier)
+		{
+			ALOG_INFO << "client " << clientIdentifier << " disconnected";
+			DisconnectClient(clientIdentifier);
+		}
+	}
+
+	// Packets only the server sends
+	template<typename PacketType>
+	void OnPacket(const PacketType&)
+	{
+		ALOG_EVERY_MS(evpp::kLogWarn, 1000) << "unexpected packet " << (int)PacketType::Id << " from " << FromAddress.ToString();
+	}
+};
+
+// The receive path after the socket, shared by cb_func and replay
+void handle_datagram(const sockaddr_in& from, const uint8_t* data, size_t size)
+{
+	Address address = Address((const sockaddr*)&from); // TODO Add compare for *sockaddr in Address class
+	ALOG_TRACE << "recv | from " << address.ToString();
+
+	if (IsFragment(data, size))
+	{
+		// Reassembly slots are only given to connected clients
+		uint16_t clientIdentifier = FindClientIdentifier(address);
+		if (clientIdentifier == InvalidIdentifier || !Reassembly.Add(clientIdentifier, data, size, NowMs(), data, size))
+		{
+			return;
+		}
+	}
+
+	ServerPacketHandler handler = { from, address };
+	DispatchResult result = GamePackets.Dispatch(handler, data, size);
+	if (result != DispatchResult::Ok)
+	{
+		ALOG_EVERY_MS(evpp::kLogWarn, 1000) << "dropped " << (result == DispatchResult::Unknown ? "unknown" : "malformed") << " packet of " << size << " bytes";
+	}
+}
 
 void cb_func(evutil_socket_t fd, short what, void* arg)
 {
 	if (what & EV_WRITE)
 	{
-		for (std::shared_ptr<Packet>& packet : packets)
+		while (sendCursor != cursor)
 		{
-			if (packet == nullptr)
-			{
-				return;
-			}
-
-			sendto(fd, (const char*)packet->data, packet->size, 0, packet->recvaddr, packet->recvaddrsize);
-			packet == nullptr;
+			std::shared_ptr<Packet>& packet = packets[sendCursor];
+			sendto(fd, (const char*)packet->data, packet->size, 0, (const sockaddr*)&packet->recvaddr, packet->recvaddrsize);
+			packet = nullptr;
+			sendCursor = (sendCursor + 1) % (int)packets.size();
 		}
 	}
 
 	if (what & EV_READ)
 	{
-		std::array<uint8_t, 1024> buffer;
-		memset(&buffer, 0, sizeof(buffer));
+		std::array<uint8_t, MAX_PACKET_SIZE> buffer;
 		/*
 		The recvfrom function reads one packet from the socket socket into the buffer buffer.
 		The size argument specifies the maximum number of bytes to be read. If the packet is longer
@@ -508,131 +766,130 @@ void cb_func(evutil_socket_t fd, short what, void* arg)
 		*/
 		sockaddr_in from;
 		int addrlen = sizeof(from);
-		int n = recvfrom(fd, (char*)&buffer, 1024, 0, (sockaddr*)&from, &addrlen);
+		int n = recvfrom(fd, (char*)&buffer, (int)buffer.size(), 0, (sockaddr*)&from, &addrlen);
 		if (n == SOCKET_ERROR)
 		{
-			std::cout << "Error reading socket: " << WSAGetLastError() << std::endl;
+			ALOG_EVERY_MS(evpp::kLogError, 1000) << "Error reading socket: " << WSAGetLastError();
 			return;
 		}
 
-		Address address = Address((sockaddr*)&from); // TODO Add compare for *sockaddr in Address class
-		std::cout << "recv | from " << address.ToString() << std::endl;
+		if (PacketCapture.IsOpen())
+		{
+			PacketCapture.Append((const sockaddr*)&from, (const char*)buffer.data(), n);
+		}
 
-		uint8_t mode = buffer[0];
-		std::cout << " - mode: " << (int)mode << std::endl;
+		handle_datagram(from, buffer.data(), n);
+	}
+}
 
-		std::bitset<8> bs(mode);
-		std::cout << " - data: " << bs << std::endl;
-		
-		return;
+int replay(const char* path, double speed)
+{
+	evpp::udp::CaptureReader reader;
+	if (!reader.Open(path))
+	{
+		std::cout << "Error: Failed to open the capture file " << path << std::endl;
+		return 1;
+	}
 
-		uint16_t clientIdentifier = FindClientIdentifier(address);
+	std::cout << "replaying " << reader.record_count() << " datagrams from " << path << std::endl;
+	// replication_cb does not run without the event loop, expire the reassembly slots at the same pace instead
+	int64_t lastExpireMs = 0;
+	evpp::udp::ReplayStats stats = evpp::udp::Replay(reader, speed, [&lastExpireMs](const evpp::udp::CaptureRecord& record)
+	{
+		ReplayClockMs = record.timestamp_ns / 1000000;
+		if (ReplayClockMs - lastExpireMs >= 50)
+		{
+			Reassembly.Expire(ReplayClockMs);
+			lastExpireMs = ReplayClockMs;
+		}
+		handle_datagram(record.remote_addr, (const uint8_t*)record.data.data(), record.data.size());
+
+		// There is no socket to send the replies to, drop them like udp::Server::Replay does
+		sendCursor = cursor;
+	});
+
+	uint64_t received = 0, malformed = 0;
+	for (size_t id = 0; id < GamePacketRegistry::MaxPackets; ++id)
+	{
+		received += GamePackets.GetCounters((uint8_t)id).Received;
+		malformed += GamePackets.GetCounters((uint8_t)id).Malformed;
+	}
+
+	std::cout << "datagrams:          " << stats.datagrams << " (" << stats.bytes << " bytes)" << std::endl;
+	std::cout << "dispatched:         " << received << ", malformed " << malformed << ", unknown " << GamePackets.GetUnknownCount() << std::endl;
+	std::cout << "reassembled:        " << Reassembly.GetStats().Completed << ", expired " << Reassembly.GetStats().Expired << ", evicted " << Reassembly.GetStats().Evicted << std::endl;
+	std::cout << "elapsed:            " << stats.elapsed_seconds << " s" << std::endl;
+	std::cout << "handler throughput: " << (stats.handler_seconds > 0 ? stats.datagrams / stats.handler_seconds : 0.0) << " datagrams/s" << std::endl;
+	return 0;
+}
+
+/*
+Per client replication, see EntityReplicationPacket. Only the entities in the client's area of interest are sent,
+the updates are picked by priority within the budget.
+*/
+const uint32_t REPLICATION_BUDGET = 1200;
+const uint32_t REPLICATION_HEADER_SIZE = sizeof(uint8_t) + 3 * sizeof(uint16_t);
+const uint32_t REPLICATION_UPDATE_SIZE = sizeof(uint32_t) + 2 * sizeof(float);
+
+std::vector<uint32_t> ReplicationEntered;
+std::vector<uint32_t> ReplicationLeft;
+std::vector<uint32_t> ReplicationUpdates;
+
+void DisconnectClient(uint16_t clientIdentifier)
+{
+	ClientConnected[clientIdentifier] = false;
+	ClientAddress[clientIdentifier] = Address();
+	Interest.RemoveClient(clientIdentifier);
+	Interest.RemoveEntity(clientIdentifier);
+	Reassembly.RemoveClient(clientIdentifier);
+}
+
+void replication_cb(evutil_socket_t fd, short what, void* arg)
+{
+	Reassembly.Expire(NowMs());
+
+	Interest.Update();
 
-		// In order of frequency
-		// if unreliable
-		if (mode == 0)
-		{
-			std::cout << "handling unreliable package" << std::endl;
-			// Forward to packet handlers
-
-			if (clientIdentifier == InvalidIdentifier)
-			{
-				std::cout << "client was not connected" << std::endl;
-				return;
-			}
-		}
-		// else if reliable
-		else if (mode == 1)
-		{
-			std::cout << "handling reliable package" << std::endl;
-
-
-			if (clientIdentifier == InvalidIdentifier)
-			{
-				std::cout << "client was not connected" << std::endl;
-				return;
-			}
-			// Forward to packet handlers
-		}
-		// else if connection type
-		else if (mode == 2)
-		{
-			// WARN: This connection protocol, although fast, very unsecure. This will have to be changed before production.
-			// Read: https://gafferongames.com/post/client_server_connection/
-
-			/*
-			If the sender corresponds to the address of a client that is already connected, also reply with connection accepted.
-			This is necessary because the first response packet may not have gotten through due to packet loss. If we dont resend this response,
-			the client gets stuck in the connecting state until it times out.
-			*/
-			if (clientIdentifier != InvalidIdentifier)
-			{
-				// Valid identifier
-				std::cout << "client already connected" << std::endl;
-
-				// TODO: send connection accepted
-				std::shared_ptr<Packet> res = std::make_shared<Packet>();
-				res->recvaddr = (sockaddr*)&from;
-				res->recvaddrsize = addrlen;
-				res->size = sizeof(uint16_t);
-				res->data = malloc(res->size);
-				memset(res->data, 0b0000001000000001, sizeof(uint16_t)); // mode, status code
-				send(res);
-				return;
-			}
-
-			// TODO challenge
-
-			/*
-			If the connection request is from a new client and we have a slot free,
-			assign the client to a free slot and respond with connection accepted.
-			*/
-			uint16_t freeIdentifier = FindFreeClientIdentifier();
-			std::cout << "Free: " << freeIdentifier << std::endl;
-			if (freeIdentifier != InvalidIdentifier)
-			{
-				std::cout << "client connected" << std::endl;
-
-				ClientAddress[freeIdentifier] = address;
-				std::cout << "retretretre: " << ClientAddress[freeIdentifier].ToString() << std::endl;
-				ClientConnected[freeIdentifier] = true;
-
-				// Send connection accepted
-				std::shared_ptr<Packet> res = std::make_shared<Packet>();
-				res->recvaddr = (sockaddr*)&from;
-				res->recvaddrsize = addrlen;
-				res->size = sizeof(uint16_t);
-				res->data = malloc(res->size);
-				memset(res->data, 0b0000001000000001, sizeof(uint16_t)); // mode, status code
-				send(res);
-				//evpp::udp::SendMessage(res);
-			}
-
-			/*
-			If the server is full, reply with connection denied.
-			*/
-			else
-			{
-				std::cout << "server full connected" << std::endl;
-
-				// Server is full, send connection denied
-				std::shared_ptr<Packet> res = std::make_shared<Packet>();
-				res->recvaddr = (sockaddr*)&from;
-				res->recvaddrsize = addrlen;
-				res->size = sizeof(uint16_t);
-				res->data = malloc(res->size);
-				memset(res->data, 0b0000001000000000, sizeof(uint16_t)); // mode, status code
-				send(res);
-				//evpp::udp::SendMessage(res);
-			}
+	EntityReplicationPacket packet;
+	for (uint16_t client = 0; client < MAX_CLIENTS; ++client)
+	{
+		if (!ClientConnected[client])
+		{
+			continue;
 		}
-		else
+
+		// Visibility changes go first, whatever does not fit waits for the next tick
+		ReplicationEntered.clear();
+		ReplicationLeft.clear();
+		Interest.TakeVisibilityChanges(client, packet.Entered.Items.size(), packet.Left.Items.size(), ReplicationEntered, ReplicationLeft);
+
+		packet.Entered.Clear();
+		packet.Left.Clear();
+		packet.Updates.Clear();
+		for (uint32_t entity : ReplicationEntered)
 		{
-			std::cout << "handling unknown package mode" << (int)mode << std::endl;
+			packet.Entered.Push(entity);
+		}
+		for (uint32_t entity : ReplicationLeft)
+		{
+			packet.Left.Push(entity);
+		}
+
+		const uint32_t visibilitySize = (uint32_t)(packet.Entered.Size() + packet.Left.Size()) * sizeof(uint32_t);
+		const uint32_t budget = std::min(REPLICATION_BUDGET - REPLICATION_HEADER_SIZE - visibilitySize, (uint32_t)(packet.Updates.Items.size() * REPLICATION_UPDATE_SIZE));
+
+		ReplicationUpdates.clear();
+		Interest.SelectUpdates(client, budget, REPLICATION_UPDATE_SIZE, ReplicationUpdates);
+		if (packet.Entered.Empty() && packet.Left.Empty() && ReplicationUpdates.empty())
+		{
+			continue;
 		}
-		// std::cout << "MSG:" << msg->NextAllString() << " - fd: " << msg->sockfd() << '\n';
-		// evpp::udp::SendMessage(msg);
-	}
 
+		for (uint32_t entity : ReplicationUpdates)
+		{
+			packet.Updates.Push(EntityState{ entity, Interest.GetGrid().GetX(entity), Interest.GetGrid().GetY(entity) });
+		}
 
+		SendPacket(packet, ClientSockAddr[client]);
+	}
 }
\ No newline at end of file